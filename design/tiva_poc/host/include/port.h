@@ -0,0 +1,43 @@
+// Ahmed Abdulla
+// Copyright 2025 Ahmed Abdulla. All Rights Reserved.
+// (Excluding work produced by Professor Jason Losh)
+//
+// Host port
+// Included ahead of every source in the host build (-include port.h).
+// Replaces the svc instruction in the generated user stubs with a call into
+// port.c, which builds the stacked frame svCallIsr expects and dispatches it.
+
+#ifndef HOST_PORT_H
+#define HOST_PORT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+//-----------------------------------------------------------------------------
+// svc trap
+//-----------------------------------------------------------------------------
+
+// Host pointers are 32 bits wide here: the binary is linked below 4GiB and
+// SRAM is mapped at its real address, so pointer arguments fit in a register
+// (SVC_EACH and SVC_PARAM come from sys/svc_table.h, which uses these stubs)
+#define SVC_WORD(reg, ...) SVC_CAT(SVC_WORD_, SVC_NARGS(__VA_ARGS__))(__VA_ARGS__)
+#define SVC_WORD_1(none) 0
+#define SVC_WORD_2(type, name) (uint32_t)(uintptr_t)(name)
+
+// Registers not in params are left 0 by the compound literal
+#define SVC_STUB_void(num, stub, params) \
+    void stub(SVC_EACH(SVC_PARAM, params)) { hostSvc(num, (const uint32_t[4]){ SVC_EACH(SVC_WORD, params) }); }
+#define SVC_STUB_VALUE(type, num, stub, params) \
+    type stub(SVC_EACH(SVC_PARAM, params)) { return (type)(uintptr_t) hostSvc(num, (const uint32_t[4]){ SVC_EACH(SVC_WORD, params) }); }
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+uint32_t hostSvc(uint8_t num, const uint32_t *args);
+
+void initHost(void);
+void stopHost(void);
+uint64_t getHostNanoseconds(void);
+
+#endif
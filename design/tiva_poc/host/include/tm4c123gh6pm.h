@@ -0,0 +1,97 @@
+// Ahmed Abdulla
+// Copyright 2025 Ahmed Abdulla. All Rights Reserved.
+// (Excluding work produced by Professor Jason Losh)
+//
+// Host register shim
+// Stands in for TI's tm4c123gh6pm.h in the host build. Only the registers and
+// fields the kernel sources use are here, at their real addresses and values.
+// port.c maps plain memory over those addresses and plays the part of the
+// hardware behind them (SysTick, WTIMER0A, PendSV).
+
+#ifndef TM4C123GH6PM_H
+#define TM4C123GH6PM_H
+
+#include <stdint.h>
+
+//-----------------------------------------------------------------------------
+// System control
+//-----------------------------------------------------------------------------
+
+#define SYSCTL_RCC_R            (*((volatile uint32_t *)0x400FE060))
+#define SYSCTL_RCGCWTIMER_R     (*((volatile uint32_t *)0x400FE65C))
+
+#define SYSCTL_RCC_XTAL_16MHZ   0x00000540
+#define SYSCTL_RCC_OSCSRC_MAIN  0x00000000
+#define SYSCTL_RCC_USESYSDIV    0x00400000
+#define SYSCTL_RCC_SYSDIV_S     23
+#define SYSCTL_RCGCWTIMER_R0    0x00000001
+
+//-----------------------------------------------------------------------------
+// Wide timer 0
+//-----------------------------------------------------------------------------
+
+#define WTIMER0_CFG_R           (*((volatile uint32_t *)0x40036000))
+#define WTIMER0_TAMR_R          (*((volatile uint32_t *)0x40036004))
+#define WTIMER0_CTL_R           (*((volatile uint32_t *)0x4003600C))
+#define WTIMER0_IMR_R           (*((volatile uint32_t *)0x40036018))
+#define WTIMER0_RIS_R           (*((volatile uint32_t *)0x4003601C))
+#define WTIMER0_ICR_R           (*((volatile uint32_t *)0x40036024))
+#define WTIMER0_TAILR_R         (*((volatile uint32_t *)0x40036028))
+#define WTIMER0_TAPR_R          (*((volatile uint32_t *)0x40036038))
+
+#define TIMER_TAMR_TAMR_M       0x00000003
+#define TIMER_TAMR_TAMR_PERIOD  0x00000002
+#define TIMER_TAMR_TACDIR       0x00000010
+#define TIMER_CTL_TAEN          0x00000001
+#define TIMER_CTL_TASTALL       0x00000002
+#define TIMER_IMR_TATOIM        0x00000001
+#define TIMER_RIS_TATORIS       0x00000001
+#define TIMER_ICR_TATOCINT      0x00000001
+#define TIMER_TAPR_TAPSR_M      0x000000FF
+#define TIMER_TAPR_TAPSRH_M     0x0000FF00
+
+//-----------------------------------------------------------------------------
+// System control block, SysTick, NVIC and MPU
+//-----------------------------------------------------------------------------
+
+#define NVIC_ST_CTRL_R          (*((volatile uint32_t *)0xE000E010))
+#define NVIC_ST_RELOAD_R        (*((volatile uint32_t *)0xE000E014))
+#define NVIC_ST_CURRENT_R       (*((volatile uint32_t *)0xE000E018))
+#define NVIC_EN2_R              (*((volatile uint32_t *)0xE000E108))
+#define NVIC_PRI23_R            (*((volatile uint32_t *)0xE000E45C))
+#define NVIC_INT_CTRL_R         (*((volatile uint32_t *)0xE000ED04))
+#define NVIC_APINT_R            (*((volatile uint32_t *)0xE000ED0C))
+#define NVIC_SYS_PRI2_R         (*((volatile uint32_t *)0xE000ED1C))
+#define NVIC_SYS_PRI3_R         (*((volatile uint32_t *)0xE000ED20))
+#define NVIC_SYS_HND_CTRL_R     (*((volatile uint32_t *)0xE000ED24))
+#define NVIC_FAULT_STAT_R       (*((volatile uint32_t *)0xE000ED28))
+#define NVIC_MM_ADDR_R          (*((volatile uint32_t *)0xE000ED34))
+#define NVIC_MPU_CTRL_R         (*((volatile uint32_t *)0xE000ED94))
+#define NVIC_MPU_NUMBER_R       (*((volatile uint32_t *)0xE000ED98))
+#define NVIC_MPU_BASE_R         (*((volatile uint32_t *)0xE000ED9C))
+#define NVIC_MPU_ATTR_R         (*((volatile uint32_t *)0xE000EDA0))
+
+#define NVIC_ST_CTRL_ENABLE     0x00000001
+#define NVIC_ST_CTRL_INTEN      0x00000002
+#define NVIC_ST_CTRL_CLK_SRC    0x00000004
+#define NVIC_ST_RELOAD_M        0x00FFFFFF
+
+#define NVIC_PRI23_INTC_M       0x00E00000
+
+#define NVIC_INT_CTRL_PEND_SV   0x10000000
+#define NVIC_INT_CTRL_PENDSTSET 0x04000000
+
+#define NVIC_APINT_VECTKEY      0x05FA0000
+#define NVIC_APINT_SYSRESETREQ  0x00000004
+
+#define NVIC_SYS_PRI2_SVC_M     0xE0000000
+#define NVIC_SYS_PRI3_TICK_M    0xE0000000
+#define NVIC_SYS_PRI3_PENDSV_M  0x00E00000
+
+#define NVIC_MPU_CTRL_ENABLE    0x00000001
+#define NVIC_MPU_CTRL_PRIVDEFEN 0x00000004
+#define NVIC_MPU_BASE_VALID     0x00000010
+#define NVIC_MPU_ATTR_ENABLE    0x00000001
+#define NVIC_MPU_ATTR_XN        0x10000000
+
+#endif
@@ -0,0 +1,601 @@
+// Ahmed Abdulla
+// Copyright 2025 Ahmed Abdulla. All Rights Reserved.
+// (Excluding work produced by Professor Jason Losh)
+//
+// Host benchmarks
+// Runs the kernel on the host port and times svc calls and context switches
+// from a task, through the same stubs and scheduler as the target.
+// Results are host time, not Cortex-M4 cycles: they compare kernel changes
+// against each other, not against the board.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sys/kernel.h"
+#include "sys/clock.h"
+#include "sys/mm.h"
+#include "sys/asm.h"
+
+//-----------------------------------------------------------------------------
+// Defines
+//-----------------------------------------------------------------------------
+
+// semaphores (the key and flash semaphores have no hardware here)
+#define pingSem keyPressed
+#define pongSem keyReleased
+#define yieldSem flashReq
+
+// event group bits
+#define pingEvents keyEvents
+#define PING_EVENT 0x01
+#define PONG_EVENT 0x80000000
+
+// queues
+#define pingQueue 0
+#define pongQueue 1
+
+#define MAX_RESULTS 32
+
+// allocator trace replay
+#define TRACE_LENGTH 1024
+#define TRACE_SLOTS 8                  // live allocations; even slots are task stacks
+#define HEAP_BLOCKS ((HEAP_TOP - HEAP_BASE)/BLOCK_SIZE)
+#define NO_HANDLE -1
+
+// scheduler comparison
+#define SCHED_MAX_TASKS 64
+
+//-----------------------------------------------------------------------------
+// Global variables
+//-----------------------------------------------------------------------------
+
+typedef struct _benchResult
+{
+    const char *name;
+    uint32_t ops;
+    uint64_t ns;
+    uint32_t switches;             // context switches into the bench task
+} benchResult;
+
+benchResult results[MAX_RESULTS];
+uint8_t resultCount = 0;
+
+uint32_t iterations = 200000;
+volatile bool yieldDone = false;
+
+// One step of a create/kill/malloc/free trace
+typedef struct _traceOp
+{
+    uint8_t slot;
+    uint16_t size;                 // bytes to allocate into slot, or 0 to free it
+} traceOp;
+
+typedef struct _traceResult
+{
+    const char *name;
+    uint32_t allocs;
+    uint32_t failed;
+} traceResult;
+
+extern reallocCounts reallocStats;
+
+// Synthetic task sets for the scheduler comparison: task i has priority
+// i % NUM_PRIORITIES, and only even tasks are ready
+uint8_t schedTasks;
+uint8_t scanPriority[SCHED_MAX_TASKS];
+bool scanReady[SCHED_MAX_TASKS];
+uint8_t scanLastRun[NUM_PRIORITIES];
+uint8_t bitmapHead[NUM_PRIORITIES];
+uint8_t bitmapNext[SCHED_MAX_TASKS];
+uint32_t bitmapReady;
+
+traceOp trace[TRACE_LENGTH];
+traceResult bestFitTrace = { "best_fit" };
+traceResult buddyTrace = { "buddy" };
+
+// The best-fit allocator as it was before the buddy allocator, on its own table
+struct
+{
+    bool isUsed;
+    uint16_t len;
+} bestFitTable[HEAP_BLOCKS];
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+// Times fn run ops times
+void runBench(const char *name, void (*fn)(uint32_t), uint32_t ops)
+{
+    benchResult *result = &results[resultCount++];
+    const uint32_t switches = tcb[taskCurrent].switches;
+    const uint64_t start = getHostNanoseconds();
+
+    fn(ops);
+
+    result->ns = getHostNanoseconds() - start;
+    result->name = name;
+    result->ops = ops;
+    result->switches = tcb[taskCurrent].switches - switches;
+}
+
+// svc trap, pointer check and dispatch of a call that does nothing
+void nullSvc(uint32_t ops)
+{
+    char c;
+    while (ops--) write(&c, 0);
+}
+
+// Pends a reschedule that keeps the same task running
+void yieldAlone(uint32_t ops)
+{
+    while (ops--) yield();
+}
+
+// Two tasks at the same priority yielding to each other, a switch per yield
+void yieldPingPong(uint32_t ops)
+{
+    post(yieldSem);
+    while (ops--) yield();
+    yieldDone = true;
+    yield();
+}
+
+// A post wakes the partner, whose post wakes this task: two switches per op
+void semaphorePingPong(uint32_t ops)
+{
+    while (ops--)
+    {
+        post(pingSem);
+        wait(pongSem);
+    }
+}
+
+// As semaphorePingPong, through one event group
+void eventPingPong(uint32_t ops)
+{
+    while (ops--)
+    {
+        setEvents(pingEvents, PING_EVENT);
+        while (!waitEvents(pingEvents, PONG_EVENT, EVENT_CLEAR));
+    }
+}
+
+// As semaphorePingPong, passing a heap block and its ownership back and forth
+void queuePingPong(uint32_t ops)
+{
+    void *p = mallocHeap(BLOCK_SIZE);
+
+    while (ops--)
+    {
+        sendQueue(pingQueue, p, QUEUE_FOREVER);
+        p = receiveQueue(pongQueue, QUEUE_FOREVER);
+    }
+
+    freeHeap(p, BLOCK_SIZE);
+}
+
+void lockUnlock(uint32_t ops)
+{
+    while (ops--)
+    {
+        lock(resource);
+        unlock(resource);
+    }
+}
+
+void mallocFree(uint32_t ops)
+{
+    void *p;
+
+    while (ops--)
+    {
+        p = mallocHeap(BLOCK_SIZE);
+        freeHeap(p, BLOCK_SIZE);
+    }
+}
+
+// Builds a repeatable trace: stacks come and go with tasks, and mallocs churn
+// between them. Every slot is freed again by the end, so the trace can loop.
+void makeTrace(void)
+{
+    static const uint16_t stackSizes[] = { 1024, 2048, 3072, 4096, 7168 };
+    static const uint16_t mallocSizes[] = { 256, 1024, 1500, 2048, 3000 };
+    bool live[TRACE_SLOTS] = { false };
+    uint32_t seed = 1;
+    uint16_t i = 0;
+    uint8_t slot;
+
+    while (i < TRACE_LENGTH - TRACE_SLOTS)
+    {
+        seed = seed*1103515245 + 12345;
+        slot = (seed >> 16) % TRACE_SLOTS;
+
+        // Tasks live longer than mallocs: kill one only every fourth time it comes up
+        if (live[slot] && slot % 2 == 0 && (seed >> 24) % 4) continue;
+
+        trace[i].slot = slot;
+        if (live[slot]) trace[i].size = 0;
+        else if (slot % 2 == 0) trace[i].size = stackSizes[(seed >> 20) % 5];
+        else trace[i].size = mallocSizes[(seed >> 20) % 5];
+        live[slot] = !live[slot];
+        i++;
+    }
+
+    for (slot = 0; slot < TRACE_SLOTS; slot++, i++)
+    {
+        trace[i].slot = slot;
+        trace[i].size = 0;
+    }
+}
+
+// Best-fit scan over the table, as mallocMemory did before the buddy allocator
+int16_t bestFitMalloc(uint32_t size_in_bytes)
+{
+    const uint16_t num_blocks = (size_in_bytes-1)/BLOCK_SIZE + 1;
+    uint16_t count = 0, prevCount = UINT16_MAX, countTemp = 0;
+    int16_t start = -1, startTemp = 0;
+    bool curr = false;
+    int i;
+
+    for (i = 0; i < HEAP_BLOCKS; i++)
+    {
+        if (!bestFitTable[i].isUsed && !curr)
+        {
+            curr = true;
+            countTemp++;
+            startTemp = i;
+        }
+        else if (!bestFitTable[i].isUsed && curr)
+        {
+            countTemp++;
+        }
+
+        if ((bestFitTable[i].isUsed || i == HEAP_BLOCKS-1) && curr)
+        {
+            curr = false;
+            if (countTemp < prevCount && countTemp >= num_blocks)
+            {
+                prevCount = count;
+                count = countTemp;
+                start = startTemp;
+            }
+            countTemp = 0;
+            startTemp = 0;
+        }
+    }
+
+    if (count < num_blocks) return NO_HANDLE;
+
+    for (i = start; i < start+num_blocks; i++) bestFitTable[i].isUsed = true;
+    bestFitTable[start].len = num_blocks;
+
+    return start;
+}
+
+void bestFitFree(int16_t start)
+{
+    int i;
+    for (i = start; i < start+bestFitTable[start].len; i++) bestFitTable[i].isUsed = false;
+    bestFitTable[start].len = 0;
+}
+
+// Replays the trace ops steps against the old best-fit allocator
+void bestFitReplay(uint32_t ops)
+{
+    int16_t handle[TRACE_SLOTS];
+    const traceOp *op;
+    uint32_t i;
+
+    for (i = 0; i < TRACE_SLOTS; i++) handle[i] = NO_HANDLE;
+
+    for (i = 0; i < ops; i++)
+    {
+        op = &trace[i % TRACE_LENGTH];
+        if (op->size)
+        {
+            handle[op->slot] = bestFitMalloc(op->size);
+            bestFitTrace.allocs++;
+            if (handle[op->slot] == NO_HANDLE) bestFitTrace.failed++;
+        }
+        else if (handle[op->slot] != NO_HANDLE)
+        {
+            bestFitFree(handle[op->slot]);
+            handle[op->slot] = NO_HANDLE;
+        }
+    }
+
+    for (i = 0; i < TRACE_SLOTS; i++) if (handle[i] != NO_HANDLE) bestFitFree(handle[i]);
+}
+
+// Replays the same trace against the buddy allocator, as kernel allocations
+// on the empty heap
+void buddyReplay(uint32_t ops)
+{
+    void *handle[TRACE_SLOTS] = { NULL };
+    const traceOp *op;
+    uint32_t i;
+
+    for (i = 0; i < ops; i++)
+    {
+        op = &trace[i % TRACE_LENGTH];
+        if (op->size)
+        {
+            handle[op->slot] = mallocMemory(op->size, NO_TASK);
+            buddyTrace.allocs++;
+            if (!handle[op->slot]) buddyTrace.failed++;
+        }
+        else if (handle[op->slot])
+        {
+            freeMemory(getHeapIndex(handle[op->slot]), NO_TASK);
+            handle[op->slot] = NULL;
+        }
+    }
+
+    for (i = 0; i < TRACE_SLOTS; i++) if (handle[i]) freeMemory(getHeapIndex(handle[i]), NO_TASK);
+}
+
+// Grows a block to two, in place when its buddy is free, else by moving it
+void reallocGrow(uint32_t ops)
+{
+    void *p;
+
+    while (ops--)
+    {
+        p = mallocHeap(BLOCK_SIZE);
+        p = reallocHeap(p, 2*BLOCK_SIZE);
+        freeHeap(p, 2*BLOCK_SIZE);
+    }
+}
+
+// Shrinks two blocks to one, always in place
+void reallocShrink(uint32_t ops)
+{
+    void *p;
+
+    while (ops--)
+    {
+        p = mallocHeap(2*BLOCK_SIZE);
+        p = reallocHeap(p, BLOCK_SIZE);
+        freeHeap(p, BLOCK_SIZE);
+    }
+}
+
+// Asks for more than the heap holds, which fails before touching the allocation
+void reallocFail(uint32_t ops)
+{
+    void *p = mallocHeap(BLOCK_SIZE);
+
+    while (ops--) reallocHeap(p, HEAP_TOP - HEAP_BASE + 1);
+
+    freeHeap(p, BLOCK_SIZE);
+}
+
+// Lays out schedTasks tasks for both schedulers: the scan sees every task,
+// the bitmap scheduler only the ready ones, on circular per-priority lists
+void makeSchedTasks(uint8_t count)
+{
+    uint8_t i, prio, tail[NUM_PRIORITIES];
+
+    schedTasks = count;
+    bitmapReady = 0;
+    for (prio = 0; prio < NUM_PRIORITIES; prio++)
+    {
+        scanLastRun[prio] = 0;
+        bitmapHead[prio] = NO_TASK;
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        prio = i % NUM_PRIORITIES;
+        scanPriority[i] = prio;
+        scanReady[i] = (i % 2 == 0);
+        if (!scanReady[i]) continue;
+
+        if (bitmapHead[prio] == NO_TASK) bitmapHead[prio] = i;
+        else bitmapNext[tail[prio]] = i;
+        bitmapNext[i] = bitmapHead[prio];
+        tail[prio] = i;
+        bitmapReady |= 0x80000000 >> prio;
+    }
+}
+
+// The two-pass scan rtosScheduler made before the ready lists, with the
+// second pass wrapping at the task count
+void scanSchedule(uint32_t ops)
+{
+    static uint8_t task = 0;
+    volatile uint8_t picked;
+    uint8_t i, lowestPrio;
+
+    while (ops--)
+    {
+        lowestPrio = NUM_PRIORITIES - 1;
+        for (i = 0; i < schedTasks; i++)
+        {
+            if (scanPriority[i] < lowestPrio && scanReady[i])
+            {
+                lowestPrio = scanPriority[i];
+                task = i;
+            }
+        }
+
+        for (i = (scanLastRun[lowestPrio] + 1) % schedTasks; i != scanLastRun[lowestPrio]; i = (i + 1) % schedTasks)
+        {
+            if (scanPriority[i] == lowestPrio && scanReady[i])
+            {
+                task = i;
+                break;
+            }
+        }
+
+        scanLastRun[lowestPrio] = task;
+        picked = task;
+    }
+    (void)picked;
+}
+
+// The ready bitmap: clz finds the priority, its list's head runs and rotates
+void bitmapSchedule(uint32_t ops)
+{
+    volatile uint8_t picked;
+    uint8_t prio;
+
+    while (ops--)
+    {
+        prio = countLeadingZeros(bitmapReady);
+        picked = bitmapHead[prio];
+        bitmapHead[prio] = bitmapNext[picked];
+    }
+    (void)picked;
+}
+
+// A sleep of one tick, to check the simulated SysTick keeps time
+void sleepTick(uint32_t ops)
+{
+    while (ops--) sleep(1);
+}
+
+//-----------------------------------------------------------------------------
+// Tasks
+//-----------------------------------------------------------------------------
+
+void idle(void)
+{
+    while (true) yield();
+}
+
+// Partner of yieldPingPong
+void yielder(void)
+{
+    wait(yieldSem);
+    while (!yieldDone) yield();
+}
+
+// Partner of semaphorePingPong
+void ponger(void)
+{
+    while (true)
+    {
+        wait(pingSem);
+        post(pongSem);
+    }
+}
+
+// Partner of eventPingPong
+void eventPonger(void)
+{
+    while (true)
+    {
+        while (!waitEvents(pingEvents, PING_EVENT, EVENT_CLEAR));
+        setEvents(pingEvents, PONG_EVENT);
+    }
+}
+
+// Partner of queuePingPong
+void queuePonger(void)
+{
+    while (true) sendQueue(pongQueue, receiveQueue(pingQueue, QUEUE_FOREVER), QUEUE_FOREVER);
+}
+
+void bench(void)
+{
+    runBench("null_svc", nullSvc, iterations);
+    runBench("yield_no_switch", yieldAlone, iterations);
+    runBench("yield_pingpong", yieldPingPong, iterations);
+    runBench("semaphore_pingpong", semaphorePingPong, iterations);
+    runBench("event_pingpong", eventPingPong, iterations);
+    runBench("queue_pingpong", queuePingPong, iterations);
+    runBench("lock_unlock", lockUnlock, iterations);
+    runBench("malloc_free", mallocFree, iterations);
+    runBench("realloc_grow", reallocGrow, iterations);
+    runBench("realloc_shrink", reallocShrink, iterations);
+    runBench("realloc_fail", reallocFail, iterations);
+    runBench("sleep_1_tick", sleepTick, 200);
+
+    stopHost();
+}
+
+//-----------------------------------------------------------------------------
+// Main
+//-----------------------------------------------------------------------------
+
+int main(int argc, char *argv[])
+{
+    benchResult *result;
+    uint8_t i;
+    bool ok;
+
+    if (argc > 1) iterations = atoi(argv[1]);
+
+    initHost();
+    initSystemClockTo40Mhz();
+    initRtos();
+    initTimers();
+
+    // The allocators replay on the empty heap, before any task takes a stack
+    makeTrace();
+    runBench("alloc_trace_best_fit", bestFitReplay, iterations);
+    runBench("alloc_trace_buddy", buddyReplay, iterations);
+
+    // Scheduling decisions only, over more tasks than the kernel holds
+    makeSchedTasks(12);
+    runBench("sched_scan_12", scanSchedule, iterations);
+    runBench("sched_bitmap_12", bitmapSchedule, iterations);
+    makeSchedTasks(32);
+    runBench("sched_scan_32", scanSchedule, iterations);
+    runBench("sched_bitmap_32", bitmapSchedule, iterations);
+    makeSchedTasks(64);
+    runBench("sched_scan_64", scanSchedule, iterations);
+    runBench("sched_bitmap_64", bitmapSchedule, iterations);
+
+    initMutex(resource);
+    initSemaphore(pingSem, 0);
+    initSemaphore(pongSem, 0);
+    initSemaphore(yieldSem, 0);
+    initEventGroup(pingEvents, 0);
+    initQueue(pingQueue, 1);
+    initQueue(pongQueue, 1);
+
+    ok =  createThread(idle, "Idle", 7, 3072, 0);
+    ok &= createThread(bench, "Bench", 4, 7168, 0);
+    ok &= createThread(yielder, "Yielder", 4, 3072, 0);
+    ok &= createThread(ponger, "Ponger", 4, 3072, 0);
+    ok &= createThread(eventPonger, "EventPonger", 4, 3072, 0);
+    ok &= createThread(queuePonger, "QueuePonger", 4, 1024, 0); // leaves a block for the message
+
+    if (!ok)
+    {
+        printf("bench: cannot create tasks\n");
+        return 1;
+    }
+
+    startRtos();
+
+    // One line per result, for scripts to pick up
+    for (i = 0; i < resultCount; i++)
+    {
+        result = &results[i];
+        printf("bench %-20s ops=%-8u ns_per_op=%-10.1f ops_per_sec=%-12.0f switches=%u\n",
+               result->name, result->ops, (double)result->ns / result->ops,
+               result->ops * 1e9 / result->ns, result->switches);
+    }
+
+    printf("realloc in_place=%u moved=%u failed=%u\n", reallocStats.inPlace, reallocStats.moved, reallocStats.failed);
+
+    for (i = 0; i < 2; i++)
+    {
+        const traceResult *replay = i ? &buddyTrace : &bestFitTrace;
+        printf("trace %-20s allocs=%-8u failed=%u\n", replay->name, replay->allocs, replay->failed);
+    }
+
+    for (i = 0; i < MAX_TASKS; i++)
+    {
+        if (tcb[i].state == STATE_INVALID) continue;
+        printf("stack %-20s size=%-6u peak=%u\n", tcb[i].name, tcb[i].stackSize, getStackPeak(i));
+    }
+
+    return 0;
+}
@@ -0,0 +1,43 @@
+// Ahmed Abdulla
+// Copyright 2025 Ahmed Abdulla. All Rights Reserved.
+// (Excluding work produced by Professor Jason Losh)
+//
+// Host board timers
+// Replaces src/boot/board.c. The cycle count is read from the host clock
+// each time, so time spent inside svc handlers and isrs is measured too,
+// and the window timer is WTIMER0A as port.c simulates it.
+
+#include <stdint.h>
+
+#include "tm4c123gh6pm.h"
+#include "sys/clock.h"
+
+// 40MHz cycles to a one second window, without a prescaler
+#define WINDOW_CYCLES 40000000
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+// The host clock always runs
+void initCycleCounter(void)
+{
+}
+
+uint32_t getCycleCount(void)
+{
+    return getHostNanoseconds() * CYCLES_PER_US / 1000;
+}
+
+void initWindowTimer(void)
+{
+    WTIMER0_TAPR_R = 0;
+    WTIMER0_TAILR_R = WINDOW_CYCLES - 1;
+    WTIMER0_IMR_R |= TIMER_IMR_TATOIM;
+    WTIMER0_CTL_R |= TIMER_CTL_TAEN;
+}
+
+void clearWindowTimer(void)
+{
+    WTIMER0_ICR_R |= TIMER_ICR_TATOCINT;
+}
@@ -0,0 +1,395 @@
+// Ahmed Abdulla
+// Copyright 2025 Ahmed Abdulla. All Rights Reserved.
+// (Excluding work produced by Professor Jason Losh)
+//
+// Host port
+// Stands in for asm.s and the hardware behind the registers the kernel uses,
+// so kernel.c, svc.c, mm.c and clock.c run unchanged as a Linux process.
+//
+// SRAM, the peripherals and the system control block are plain memory mapped
+// at their real addresses. Each task runs on its own ucontext, with its stack
+// in the simulated SRAM heap, and svc calls come in through hostSvc().
+//
+// Interrupts are polled: SysTick, WTIMER0A and PendSV are delivered when a
+// task makes an svc call, in the order the NVIC would take them. A task that
+// computes without making svc calls is never preempted.
+
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <ucontext.h>
+#include <sys/mman.h>
+
+#include "tm4c123gh6pm.h"
+#include "sys/kernel.h"
+#include "sys/clock.h"
+#include "sys/svc.h"
+#include "sys/asm.h"
+
+//-----------------------------------------------------------------------------
+// Defines
+//-----------------------------------------------------------------------------
+
+// IPSR exception numbers
+#define SVCALL_EXCEPTION  11
+#define PENDSV_EXCEPTION  14
+#define SYSTICK_EXCEPTION 15
+#define WTIMER0A_EXCEPTION (16 + 94)
+
+// MSP stack, bounded by the symbols the TI linker would provide
+#define KERNEL_STACK_SIZE 1024
+
+extern uint32_t __stack;
+extern uint32_t __STACK_END;
+__asm__(".pushsection .bss\n"
+        ".balign 8\n"
+        ".globl __stack\n"
+        "__stack:\n"
+        ".skip 1024\n" // KERNEL_STACK_SIZE
+        ".globl __STACK_END\n"
+        "__STACK_END:\n"
+        ".popsection\n");
+
+//-----------------------------------------------------------------------------
+// Global variables
+//-----------------------------------------------------------------------------
+
+// Simulated address space: SRAM, peripherals, private peripheral bus
+static const struct
+{
+    uintptr_t base;
+    size_t size;
+} hostRegions[] = {
+    { 0x20000000, 0x8000 },
+    { 0x40000000, 0x100000 },
+    { 0xE0000000, 0x10000 },
+};
+
+extern uint8_t taskNext;
+
+// Core registers
+static uint32_t *hostPsp = NULL;
+static uint32_t hostIpsr = 0;
+static uint32_t hostControl = 0;
+static uint32_t hostBasepri = 0;
+
+// Task contexts, and main's while the rtos runs
+static ucontext_t hostContext[MAX_TASKS];
+static ucontext_t hostMainContext;
+static bool rtosRunning = false;
+
+// svc #imm instructions the stacked pc of each svc call points past
+static uint8_t svcOpcodes[SVC_COUNT][2];
+
+// Time base
+static struct timespec hostStart;
+
+// SysTick
+static bool stPending = false;     // kept apart from INT_CTRL, which the kernel overwrites
+static uint64_t stDeadline = 0;
+static uint64_t stSampled = 0;     // when CURRENT was last brought up to date
+static uint32_t stShadow = 0;
+
+// WTIMER0A
+static bool wtRunning = false;
+static uint64_t wtDeadline = 0;
+
+//-----------------------------------------------------------------------------
+// Time base
+//-----------------------------------------------------------------------------
+
+uint64_t getHostNanoseconds(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)(now.tv_sec - hostStart.tv_sec) * 1000000000ull + now.tv_nsec - hostStart.tv_nsec;
+}
+
+// Simulated 40MHz cycles since initHost
+static uint64_t getHostCycles(void)
+{
+    return getHostNanoseconds() * CYCLES_PER_US / 1000;
+}
+
+//-----------------------------------------------------------------------------
+// Hardware
+//-----------------------------------------------------------------------------
+
+// Brings the free-running registers up to date and latches expired timers
+static void updateHardware(void)
+{
+    const uint64_t now = getHostCycles();
+    uint64_t period;
+
+    // SysTick counts down from RELOAD; writing CURRENT restarts the count.
+    // The kernel writes it from handlers that run just after an update, so
+    // the count restarts from that update rather than from this one.
+    if ((NVIC_ST_CTRL_R & NVIC_ST_CTRL_ENABLE) && (NVIC_ST_RELOAD_R & NVIC_ST_RELOAD_M))
+    {
+        period = (NVIC_ST_RELOAD_R & NVIC_ST_RELOAD_M) + 1;
+
+        if (NVIC_ST_CURRENT_R != stShadow) stDeadline = ((now - stSampled < period) ? stSampled : now) + period;
+        if (now >= stDeadline)
+        {
+            if (NVIC_ST_CTRL_R & NVIC_ST_CTRL_INTEN) stPending = true;
+            stDeadline = now + period - (now - stDeadline) % period;
+        }
+
+        // Reads RELOAD..1 like the counter, never 0 so a write of 0 is always seen
+        stShadow = stDeadline - now;
+        if (stShadow >= period) stShadow = period - 1;
+        NVIC_ST_CURRENT_R = stShadow;
+        stSampled = now;
+    }
+
+    // WTIMER0A periodic timeout, prescaled by TAPR
+    if ((WTIMER0_CTL_R & TIMER_CTL_TAEN) && (WTIMER0_IMR_R & TIMER_IMR_TATOIM))
+    {
+        period = (uint64_t)(WTIMER0_TAILR_R + 1) * ((WTIMER0_TAPR_R & 0xFFFF) + 1);
+
+        if (!wtRunning) wtDeadline = now + period;
+        wtRunning = true;
+        if (now >= wtDeadline)
+        {
+            WTIMER0_RIS_R |= TIMER_RIS_TATORIS;
+            wtDeadline = now + period - (now - wtDeadline) % period;
+        }
+    }
+    else wtRunning = false;
+
+    if (stPending) NVIC_INT_CTRL_R |= NVIC_INT_CTRL_PENDSTSET;
+}
+
+// Runs whatever the NVIC has pending, highest priority first. PendSV goes
+// last, which may switch this context out until the task is chosen again.
+static void serviceInterrupts(void)
+{
+    const uint32_t ipsr = hostIpsr;
+
+    updateHardware();
+
+    if (stPending)
+    {
+        stPending = false;
+        NVIC_INT_CTRL_R &= ~NVIC_INT_CTRL_PENDSTSET;
+        hostIpsr = SYSTICK_EXCEPTION;
+        systickIsr();
+        updateHardware();
+    }
+
+    if (WTIMER0_RIS_R & TIMER_RIS_TATORIS)
+    {
+        hostIpsr = WTIMER0A_EXCEPTION;
+        wTimer0AIsr();
+        WTIMER0_RIS_R = 0;
+        WTIMER0_ICR_R = 0;
+    }
+
+    if (NVIC_INT_CTRL_R & NVIC_INT_CTRL_PEND_SV)
+    {
+        NVIC_INT_CTRL_R &= ~NVIC_INT_CTRL_PEND_SV;
+        hostIpsr = PENDSV_EXCEPTION;
+        pendSvIsr();
+    }
+
+    // SYSRESETREQ (reboot) ends the simulation
+    if (NVIC_APINT_R & NVIC_APINT_SYSRESETREQ) stopHost();
+
+    hostIpsr = ipsr;
+}
+
+//-----------------------------------------------------------------------------
+// Tasks
+//-----------------------------------------------------------------------------
+
+// First code a task runs. A task function that returns is killed, where the
+// target would fault on the zero lr initTaskStack leaves it.
+static void hostTaskEntry(void)
+{
+    const _fn pid = tcb[taskCurrent].pid;
+
+    hostIpsr = 0;
+    pid();
+    killThread(pid);
+}
+
+// Points a task's context at the start of its function, on its SRAM stack
+// below the frame initTaskStack built
+static void initTaskContext(uint8_t task)
+{
+    getcontext(&hostContext[task]);
+    hostContext[task].uc_stack.ss_sp = tcb[task].stackBase;
+    hostContext[task].uc_stack.ss_size = (uint8_t *)tcb[task].sp - (uint8_t *)tcb[task].stackBase;
+    hostContext[task].uc_link = NULL;
+    makecontext(&hostContext[task], hostTaskEntry, 0);
+}
+
+// PendSV handler: the same two halves asm.s calls, with the register save
+// and restore done by swapcontext
+void pendSvIsr(void)
+{
+    const uint8_t task = taskCurrent;
+    bool fresh;
+
+    if (selectNextTask() == SWITCH_NONE) return;
+
+    fresh = (tcb[taskNext].state == STATE_UNRUN);
+    switchTask(hostPsp - 8); // as if r4-r11 were pushed, so setTaskResult finds r0
+    if (fresh) initTaskContext(taskCurrent);
+
+    swapcontext(&hostContext[task], &hostContext[taskCurrent]);
+}
+
+//-----------------------------------------------------------------------------
+// svc trap
+//-----------------------------------------------------------------------------
+
+// Takes an svc exception: stacks args as r0-r3 and a pc just past "svc #num" on the
+// task's stack, dispatches through svCallIsr and returns the stacked r0
+uint32_t hostSvc(uint8_t num, const uint32_t *args)
+{
+    uint32_t frame[8] = { args[0], args[1], args[2], args[3], 0, 0, 0, 0x01000000 };
+    uint32_t result;
+
+    frame[6] = (uint32_t)(uintptr_t)&svcOpcodes[num][2];
+
+    hostPsp = frame;
+    hostIpsr = SVCALL_EXCEPTION;
+
+    updateHardware();
+    svCallIsr();
+    serviceInterrupts();
+
+    // Back in this task, possibly after others ran. The exception return pops
+    // the frame, and nothing reads the psp again before the next svc.
+    result = frame[0];
+    hostPsp = NULL;
+    hostIpsr = 0;
+
+    return result;
+}
+
+//-----------------------------------------------------------------------------
+// asm.s
+//-----------------------------------------------------------------------------
+
+// Runs the first task until stopHost is called, then returns to startRtos
+void startRtosHelper(void *fn)
+{
+    (void)fn;
+
+    hostControl |= 3;
+    initTaskContext(taskCurrent);
+    rtosRunning = true;
+    swapcontext(&hostMainContext, &hostContext[taskCurrent]);
+
+    rtosRunning = false;
+    hostControl = 0;
+    hostIpsr = 0;
+}
+
+void setPsp(void *ptr)
+{
+    hostPsp = ptr;
+}
+
+void setAsp(bool on)
+{
+    hostControl = (hostControl & ~2) | (on << 1);
+}
+
+void setTmpl(bool on)
+{
+    hostControl = (hostControl & ~1) | on;
+}
+
+uint32_t svcResult(void)
+{
+    return hostPsp ? hostPsp[0] : 0;
+}
+
+uint32_t *getPsp(void)
+{
+    return hostPsp;
+}
+
+uint32_t *getSp(void)
+{
+    return hostControl & 2 ? hostPsp : getMsp();
+}
+
+uint32_t *getMsp(void)
+{
+    return &__STACK_END;
+}
+
+uint32_t getIpsr(void)
+{
+    return hostIpsr;
+}
+
+uint32_t getControl(void)
+{
+    return hostControl;
+}
+
+uint32_t countLeadingZeros(uint32_t value)
+{
+    return value ? __builtin_clz(value) : 32;
+}
+
+// As basepri_max: only ever raises the mask (a lower nonzero value masks more)
+uint32_t raiseBasepri(void)
+{
+    const uint32_t basepri = hostBasepri;
+    const uint32_t kernel = (uint32_t)KERNEL_INT_PRIORITY << 5;
+
+    if (hostBasepri == 0 || kernel < hostBasepri) hostBasepri = kernel;
+    return basepri;
+}
+
+void restoreBasepri(uint32_t basepri)
+{
+    hostBasepri = basepri;
+}
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+// Maps the simulated address space; must run before anything touches a register
+void initHost(void)
+{
+    void *p;
+    uint32_t i;
+
+    clock_gettime(CLOCK_MONOTONIC, &hostStart);
+
+    for (i = 0; i < sizeof(hostRegions)/sizeof(hostRegions[0]); i++)
+    {
+        p = mmap((void *)hostRegions[i].base, hostRegions[i].size, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+        if (p != (void *)hostRegions[i].base)
+        {
+            fprintf(stderr, "host: cannot map 0x%08lx\n", (unsigned long)hostRegions[i].base);
+            exit(1);
+        }
+    }
+
+    for (i = 0; i < SVC_COUNT; i++)
+    {
+        svcOpcodes[i][0] = i;
+        svcOpcodes[i][1] = 0xDF; // svc #imm encoding
+    }
+}
+
+// Leaves the rtos and returns from startRtos in main, or exits before then
+void stopHost(void)
+{
+    if (rtosRunning) setcontext(&hostMainContext);
+    exit(0);
+}
@@ -0,0 +1,295 @@
+// Ahmed Abdulla
+// Copyright 2025 Ahmed Abdulla. All Rights Reserved.
+// (Excluding work produced by Professor Jason Losh)
+//
+// Host tests
+// Runs the kernel on the host port and checks behavior that needs a running
+// scheduler and real time, from a task, through the same stubs as the target.
+// Exits non-zero if any check fails.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "sys/kernel.h"
+#include "sys/clock.h"
+#include "sys/svc.h"
+#include "sys/mm.h"
+#include "util/slab.h"
+
+//-----------------------------------------------------------------------------
+// Defines
+//-----------------------------------------------------------------------------
+
+// tickless test
+#define TICKLESS_SLEEPS 100
+#define TICKLESS_SLEEP_MS 7
+#define TICKLESS_SLACK_MS 2            // wall time read around the ticks
+#define TICKLESS_SLACK_PERCENT 10      // ticks lost while the host process is descheduled
+
+// slab tests
+#define SLAB_CYCLES 1000
+#define MIX_LENGTH 38                  // one pass over the message size mix
+#define MAX_MIX_OBJECTS 512
+
+//-----------------------------------------------------------------------------
+// Global variables
+//-----------------------------------------------------------------------------
+
+extern uint32_t tickCount;
+extern heap_block heap_alloc_table[MAX_BLOCKS];
+
+uint32_t passed = 0;
+uint32_t failed = 0;
+
+// A realistic mix of small objects: 20 x 40B message buffers, 10 x 100B,
+// 6 x 200B and 2 x 500B, interleaved
+const uint16_t mixSizes[MIX_LENGTH] =
+{
+    40, 100, 40, 200, 40, 40, 100, 500, 40, 200, 40, 100, 40, 40, 100, 200, 40, 40, 100,
+    40, 200, 40, 100, 40, 500, 40, 100, 200, 40, 40, 100, 40, 200, 40, 100, 40, 40, 40
+};
+
+// Host memory, outside the kernel's view like the task's own data would be
+void *mixObjects[MAX_MIX_OBJECTS];
+slabHeap testSlab;
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+void test(void);
+
+void check(const char *name, bool ok)
+{
+    printf("test %-32s %s\n", name, ok ? "ok" : "FAIL");
+    if (ok) passed++;
+    else failed++;
+}
+
+// Sleeps while Idle keeps yielding, so every stretched tick is ended early
+// and restretched many times before it runs out. tickCount must still
+// follow wall time.
+void testTicklessEarlyWake(void)
+{
+    uint64_t startNs, ms;
+    uint32_t startTick, ticks;
+    uint32_t i;
+
+    tickless(true);
+
+    sleep(1);
+    startTick = tickCount;
+    startNs = getHostNanoseconds();
+
+    for (i = 0; i < TICKLESS_SLEEPS; i++) sleep(TICKLESS_SLEEP_MS);
+
+    ticks = tickCount - startTick;
+    ms = (getHostNanoseconds() - startNs) / 1000000;
+
+    tickless(false);
+
+    printf("tickless ticks=%u wall_ms=%u\n", ticks, (uint32_t)ms);
+    // Like the NVIC, the host keeps one pending systick, so ticks can only fall behind
+    check("tickless_ticks_follow_wall_time", ticks <= ms + TICKLESS_SLACK_MS
+          && ms <= ticks + ticks * TICKLESS_SLACK_PERCENT / 100 + TICKLESS_SLACK_MS);
+    check("tickless_sleeps_complete", ticks >= TICKLESS_SLEEPS * TICKLESS_SLEEP_MS);
+}
+
+// Ids past the end of the kernel tables are turned away by the dispatcher,
+// before the handler indexes anything. hostSvc returns the stacked r0.
+void testSvcIndexChecks(void)
+{
+    const uint8_t priority = tcb[taskCurrent].priority;
+
+    check("svc_lock_bad_mutex", (int32_t)hostSvc(SVC_LOCK, (const uint32_t[4]){ MAX_MUTEXES }) == SVC_ERR_ARG);
+    check("svc_unlock_bad_mutex", (int32_t)hostSvc(SVC_UNLOCK, (const uint32_t[4]){ MAX_MUTEXES }) == SVC_ERR_ARG);
+    check("svc_wait_negative_semaphore", (int32_t)hostSvc(SVC_WAIT, (const uint32_t[4]){ (uint32_t)-1 }) == SVC_ERR_ARG);
+    check("svc_post_bad_semaphore", (int32_t)hostSvc(SVC_POST, (const uint32_t[4]){ MAX_SEMAPHORES }) == SVC_ERR_ARG);
+    check("svc_priority_out_of_range",
+          (int32_t)hostSvc(SVC_SETTHREADPRIORITY, (const uint32_t[4]){ (uint32_t)test, NUM_PRIORITIES }) == SVC_ERR_ARG
+          && tcb[taskCurrent].priority == priority);
+
+    // The last valid ids still reach their handlers
+    check("svc_post_last_semaphore", (int32_t)hostSvc(SVC_POST, (const uint32_t[4]){ MAX_SEMAPHORES - 1 }) != SVC_ERR_ARG
+          && semaphores[MAX_SEMAPHORES - 1].count == 1);
+    wait(MAX_SEMAPHORES - 1);
+}
+
+// Every class hands out distinct, writable objects, sized by class, and
+// bigger requests come from mallocHeap
+void testSlabClasses(void)
+{
+    const uint32_t sizes[] = { 1, 16, 17, 40, 100, 200, 500, 512 };
+    const uint8_t classes[] = { 0, 0, 1, 2, 3, 4, 5, 5 };
+    uint8_t *objects[8];
+    uint8_t *big;
+    slabStats stats;
+    bool ok = true;
+    uint32_t i, j;
+
+    initSlabHeap(&testSlab);
+
+    for (i = 0; i < 8; i++)
+    {
+        objects[i] = slabAlloc(&testSlab, sizes[i]);
+        ok &= objects[i] != NULL;
+        if (objects[i]) for (j = 0; j < sizes[i]; j++) objects[i][j] = i;
+    }
+    for (i = 0; i < 8; i++)
+    {
+        for (j = 0; objects[i] && j < sizes[i]; j++) ok &= objects[i][j] == i;
+    }
+    check("slab_objects_hold_their_data", ok);
+
+    getSlabStats(&testSlab, &stats);
+    ok = stats.bytesHeld == 6 * SLAB_PAGE_SIZE;
+    for (i = 0; i < 8; i++) ok &= stats.pages[classes[i]] == 1;
+    ok &= stats.used[0] == 2 && stats.capacity[0] == SLAB_PAGE_SIZE / 16;
+    ok &= stats.used[5] == 2 && stats.capacity[5] == 2;
+    ok &= stats.bytesUsed == 2*16 + 32 + 64 + 128 + 256 + 2*512;
+    check("slab_stats_count_each_class", ok);
+
+    big = slabAlloc(&testSlab, SLAB_MAX_SIZE + 1);
+    getSlabStats(&testSlab, &stats);
+    check("slab_large_from_mallocHeap", big && heap_alloc_table[getHeapIndex(big)].len == 1 && stats.bytesHeld == 6 * SLAB_PAGE_SIZE);
+    slabFree(&testSlab, big);
+
+    for (i = 0; i < 8; i++) slabFree(&testSlab, objects[i]);
+    trimSlabHeap(&testSlab);
+    getSlabStats(&testSlab, &stats);
+    check("slab_trim_returns_pages", stats.bytesHeld == 0);
+}
+
+// Once a class has a page, alloc/free stays in the task
+void testSlabNoSvc(void)
+{
+    uint32_t svcCalls, i;
+    void *keep, *object;
+    bool ok = true;
+
+    initSlabHeap(&testSlab);
+    keep = slabAlloc(&testSlab, 40);
+    svcCalls = tcb[taskCurrent].svcCalls;
+
+    for (i = 0; i < SLAB_CYCLES; i++)
+    {
+        object = slabAlloc(&testSlab, 40);
+        ok &= object != NULL && object != keep;
+        slabFree(&testSlab, object);
+    }
+
+    // The last object out keeps its page, so the cycle doesn't move to an svc
+    slabFree(&testSlab, keep);
+    object = slabAlloc(&testSlab, 40);
+    slabFree(&testSlab, object);
+
+    check("slab_alloc_free_without_svc", ok && tcb[taskCurrent].svcCalls == svcCalls);
+
+    trimSlabHeap(&testSlab);
+}
+
+// Pages of a class fill before another is taken, and an emptied page goes
+// back while the class has room elsewhere
+void testSlabPages(void)
+{
+    const uint32_t perPage = SLAB_PAGE_SIZE / 16;
+    const uint32_t heapFree = getFreeHeap();
+    slabStats stats;
+    uint32_t i;
+    bool ok = true;
+
+    initSlabHeap(&testSlab);
+    for (i = 0; i < perPage + 1; i++) ok &= (mixObjects[i] = slabAlloc(&testSlab, 16)) != NULL;
+    getSlabStats(&testSlab, &stats);
+    check("slab_second_page_when_full", ok && stats.pages[0] == 2 && getFreeHeap() == heapFree - 2*SLAB_PAGE_SIZE);
+
+    for (i = 0; i < perPage; i++) slabFree(&testSlab, mixObjects[i]);
+    getSlabStats(&testSlab, &stats);
+    check("slab_empty_page_returned", stats.pages[0] == 1 && stats.used[0] == 1 && getFreeHeap() == heapFree - SLAB_PAGE_SIZE);
+
+    slabFree(&testSlab, mixObjects[perPage]);
+    trimSlabHeap(&testSlab);
+    check("slab_heap_restored", getFreeHeap() == heapFree);
+}
+
+// Allocates the mix until the heap runs out, through mallocHeap and then
+// through a slab heap, and reports how much more fits
+void testSlabCapacity(void)
+{
+    const uint32_t heapFree = getFreeHeap();
+    uint32_t heapObjects = 0, slabObjects = 0, bytes = 0, i;
+    slabStats stats;
+
+    while (heapObjects < MAX_MIX_OBJECTS && (mixObjects[heapObjects] = mallocHeap(mixSizes[heapObjects % MIX_LENGTH]))) heapObjects++;
+    for (i = 0; i < heapObjects; i++) freeHeap(mixObjects[i], 1);
+
+    initSlabHeap(&testSlab);
+    while (slabObjects < MAX_MIX_OBJECTS && (mixObjects[slabObjects] = slabAlloc(&testSlab, mixSizes[slabObjects % MIX_LENGTH])))
+    {
+        bytes += mixSizes[slabObjects % MIX_LENGTH];
+        slabObjects++;
+    }
+    getSlabStats(&testSlab, &stats);
+    for (i = 0; i < slabObjects; i++) slabFree(&testSlab, mixObjects[i]);
+    trimSlabHeap(&testSlab);
+
+    printf("slab mix heap_free=%u mallocHeap_objects=%u slab_objects=%u requested=%u used=%u held=%u\n",
+           heapFree, heapObjects, slabObjects, bytes, stats.bytesUsed, stats.bytesHeld);
+    check("slab_mix_fits_more", slabObjects > heapObjects && getFreeHeap() == heapFree);
+}
+
+//-----------------------------------------------------------------------------
+// Tasks
+//-----------------------------------------------------------------------------
+
+void idle(void)
+{
+    while (true) yield();
+}
+
+void test(void)
+{
+    testTicklessEarlyWake();
+    testSvcIndexChecks();
+    testSlabClasses();
+    testSlabNoSvc();
+    testSlabPages();
+    testSlabCapacity();
+
+    stopHost();
+}
+
+//-----------------------------------------------------------------------------
+// Main
+//-----------------------------------------------------------------------------
+
+int main(void)
+{
+    bool ok;
+
+    // A test that hangs still shows the ones before it
+    setvbuf(stdout, NULL, _IONBF, 0);
+
+    initHost();
+    initSystemClockTo40Mhz();
+    initRtos();
+    initTimers();
+
+    initSemaphore(MAX_SEMAPHORES - 1, 0);
+
+    ok =  createThread(idle, "Idle", 7, 3072, 0);
+    ok &= createThread(test, "Test", 4, 4096, 0);
+
+    if (!ok)
+    {
+        printf("test: cannot create tasks\n");
+        return 1;
+    }
+
+    startRtos();
+
+    printf("tests passed=%u failed=%u\n", passed, failed);
+
+    return failed ? 1 : 0;
+}
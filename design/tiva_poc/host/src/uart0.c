@@ -0,0 +1,140 @@
+// Ahmed Abdulla
+// Copyright 2025 Ahmed Abdulla. All Rights Reserved.
+// (Excluding work produced by Professor Jason Losh)
+//
+// Host UART0
+// The uart0.h interface over stdout. Transmit never fills, so nothing blocks
+// or drops, and there is no receive side: readUart0Line never has a line.
+// Tasks still write through the write svc, so pointer checks and svc counts
+// match the target.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "io/uart0.h"
+#include "sys/kernel.h"
+#include "sys/asm.h"
+#include "util/str.h"
+
+// IPSR exception numbers of NMI and the fault handlers
+#define FIRST_FAULT_EXCEPTION 2
+#define LAST_FAULT_EXCEPTION 6
+
+//-----------------------------------------------------------------------------
+// Global variables
+//-----------------------------------------------------------------------------
+
+uartStats uart0Stats = {0};
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+void initUart0()
+{
+}
+
+void setUart0BaudRate(uint32_t baudRate, uint32_t fcyc)
+{
+}
+
+// Kernel side only: must run at KERNEL_INT_PRIORITY
+uint32_t writeUart0(const char *str, uint32_t size)
+{
+    return fwrite(str, 1, size, stdout);
+}
+
+// Kernel side only: must run at KERNEL_INT_PRIORITY
+bool readUart0Line(char *str, uint32_t size)
+{
+    return false;
+}
+
+void putcPolledUart0(char c)
+{
+    putchar(c);
+}
+
+// Same caller paths as the target: privileged thread mode and faults write
+// directly, kernel handlers call writeUart0, tasks go through the write svc
+void putUart0(const char *str, uint32_t size)
+{
+    const uint32_t exception = getIpsr() & 0x1FF;
+    int32_t count;
+
+    if ((exception == 0 && !(getControl() & 1))
+        || (exception >= FIRST_FAULT_EXCEPTION && exception <= LAST_FAULT_EXCEPTION))
+    {
+        while (size--) putcPolledUart0(*str++);
+    }
+    else if (exception != 0)
+    {
+        count = writeUart0(str, size);
+        uart0Stats.txDropped += size - count;
+    }
+    else
+    {
+        while (size > 0)
+        {
+            count = write((char *)str, size);
+            if (count < 0) return; // buffer rejected by the kernel
+            str += count;
+            size -= count;
+        }
+    }
+}
+
+void putcUart0(char c)
+{
+    putUart0(&c, 1);
+}
+
+void putsUart0(char *str)
+{
+    putUart0(str, _strlen(str));
+}
+
+void putHexUart0(uint32_t num)
+{
+    char dispStr[12] = "0x";
+
+    _itoh(num, dispStr+2);
+    putsUart0(dispStr);
+}
+
+void putIntUart0(uint32_t num)
+{
+    char dispStr[11] = "";
+
+    _itoa(num, dispStr);
+    putsUart0(dispStr);
+}
+
+void putHexFieldUart0(uint32_t num, uint8_t fieldSize)
+{
+    char dispStr[12] = "0x";
+
+    _itoh(num, dispStr+2);
+    putFieldUart0(dispStr, fieldSize);
+}
+
+void putIntFieldUart0(uint32_t num, uint8_t fieldSize)
+{
+    char dispStr[11] = "";
+
+    _itoa(num, dispStr);
+    putFieldUart0(dispStr, fieldSize);
+}
+
+void putFieldUart0(char *str, uint8_t fieldSize)
+{
+    const uint32_t inputLen = _strlen(str);
+
+    putsUart0(str);
+    while (fieldSize-- > inputLen) putcUart0(' ');
+}
+
+void uart0Isr(void)
+{
+}
@@ -11,10 +11,16 @@
 #ifndef SHELL_H_
 #define SHELL_H_
 
+#include <stdint.h>
+
 //-----------------------------------------------------------------------------
 // Subroutines
 //-----------------------------------------------------------------------------
 
 void shell(void);
+uint32_t getStackFit(uint32_t peak);
+void printPs(void);
+void printIpcs(void);
+void printMemInfo(void);
 
 #endif
@@ -24,16 +24,25 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+#include "sys/kernel.h"
+
 //-----------------------------------------------------------------------------
 // Subroutines
 //-----------------------------------------------------------------------------
 
 void initUart0();
+void initUart0Board(void); // clocks and pins (src/boot/board.c, or the port's own)
 void setUart0BaudRate(uint32_t baudRate, uint32_t fcyc);
 void putcUart0(char c);
 void putsUart0(char* str);
-char getcUart0();
-bool kbhitUart0();
+void putUart0(const char *str, uint32_t size);
+void putcPolledUart0(char c);
+void uart0Isr(void);
+
+// Kernel side (KERNEL_INT_PRIORITY only)
+uint32_t writeUart0(const char *str, uint32_t size);
+bool readUart0Line(char *str, uint32_t size);
+extern uartStats uart0Stats;
 
 void putIntUart0(uint32_t);
 void putHexUart0(uint32_t);
@@ -12,16 +12,18 @@ extern void setPsp(void *ptr);
 extern void setAsp(bool on);
 extern void setTmpl(bool on);
 
-extern uint8_t getSvcNum(void);
-extern union svc_param getSvcParam(void);
-extern union svc_param2 getSvcParam2(void);
+extern uint32_t svcResult(void);
 
 extern uint32_t *getPsp(void);
 extern uint32_t *getSp(void);
 extern uint32_t *getMsp(void);
+extern uint32_t getIpsr(void);
+extern uint32_t getControl(void);
+
+extern uint32_t countLeadingZeros(uint32_t value);
+
+extern uint32_t raiseBasepri(void);
+extern void restoreBasepri(uint32_t basepri);
 
-extern void initUnrunTask(void *fn);
-extern void saveRegPendsv(void);
-extern void restoreRegPendsv(void);
 
 #endif
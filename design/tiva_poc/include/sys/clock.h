@@ -24,6 +24,7 @@
 #define CLOCK_H_
 
 #include <stdint.h>
+#include <stdbool.h>
 
 //-----------------------------------------------------------------------------
 // Subroutines
@@ -31,16 +32,30 @@
 
 void initSystemClockTo40Mhz(void);
 
+#define CYCLES_PER_US 40
+
 void initTimers();
+uint32_t getCycleCount(void);
 void startCurrentTaskDuration();
 uint32_t getCurrentTaskDuration();
-void finishCurrentTaskDuration();
+void enterKernelTime(void);
+void exitKernelTime(void);
 
+// Cpu stats, published once a window. Read them between readCpuStatsBegin
+// and readCpuStatsRetry, and again if the retry returns true.
+uint32_t readCpuStatsBegin(void);
+bool readCpuStatsRetry(uint32_t seq);
 uint32_t getCpuTime(uint8_t task);
-void convertCpuTimeToPercent(uint32_t rawtime, uint8_t *integer, uint8_t *fraction);
-void getCpuTimeAsPercent(uint8_t task, uint8_t *integer, uint8_t *fraction);
+uint32_t getCpuLoad(uint8_t task, uint8_t window);
+uint32_t getCpuWindow(void);
+uint32_t updateCpuLoad(uint32_t load, uint32_t share, uint32_t decay);
+void closeCpuWindow(void);
 
 void wTimer0AIsr(void);
-void wTimer0BIsr(void);
+
+// Board timers (src/boot/board.c, or the port's own)
+void initCycleCounter(void);
+void initWindowTimer(void);
+void clearWindowTimer(void);
 
 #endif
@@ -35,15 +35,47 @@ typedef void (*_fn)();
 #define resource 0
 
 // semaphore
-#define MAX_SEMAPHORES 3
-#define MAX_SEMAPHORE_QUEUE_SIZE 2
+#define MAX_SEMAPHORES 5
+#define MAX_SEMAPHORE_QUEUE_SIZE MAX_TASKS // any task can block on the uart semaphores
 #define keyPressed 0
 #define keyReleased 1
 #define flashReq 2
+#define uartTxSpace 3 // posted by the uart0 isr to writers blocked on a full tx ring
+#define uartRxLine 4 // posted by the uart0 isr to readers once a line is typed
+
+// event groups
+#define MAX_EVENT_GROUPS 1
+#define keyEvents 0
+#define KEY_PRESSED  0x00000001 // set by readKeys once a button is down
+#define KEY_RELEASED 0x00000002 // set by debounce once all buttons are up (and by initTasks)
+// waitEvents options
+#define EVENT_WAIT_ALL 0x01 // every bit of the mask, rather than any
+#define EVENT_CLEAR    0x02 // clear the bits that satisfied the wait
+
+// message queues (a queue of depth 1 is a mailbox)
+#define MAX_QUEUES 2
+#define MAX_QUEUE_DEPTH 8
+#define QUEUE_FOREVER 0xFFFFFFFF // sendQueue/receiveQueue timeout that never expires
 
 // tasks
 #define MAX_TASKS 12
 
+// heap block kept below each stack with no task access, so an overflow
+// faults instead of writing into the neighbouring allocation. Off by default:
+// it costs a block per task, and can double a stack's allocation once rounded
+// to a power of 2. Build with STACK_GUARD_SIZE=0x400 to turn it on.
+#ifndef STACK_GUARD_SIZE
+#define STACK_GUARD_SIZE 0
+#endif
+
+// initial stack frame: r4-r11 saved by pendsv, then r0-r3, r12, lr, pc, xPSR
+#define TASK_FRAME_WORDS 16
+
+// exception priorities (0=highest, 7=lowest)
+// svc, systick and any ISR that touches kernel state run at KERNEL_INT_PRIORITY
+#define KERNEL_INT_PRIORITY 6
+#define PENDSV_INT_PRIORITY 7
+
 // task states (moved from kernel.c)
 #define STATE_INVALID           0 // no task
 #define STATE_UNRUN             1 // task has never been run
@@ -52,23 +84,66 @@ typedef void (*_fn)();
 #define STATE_BLOCKED_SEMAPHORE 4 // has run, but now blocked by semaphore
 #define STATE_BLOCKED_MUTEX     5 // has run, but now blocked by mutex
 #define STATE_KILLED            6 // task has been killed
+#define STATE_BLOCKED_EVENT     7 // has run, but now waiting on an event group
+#define STATE_BLOCKED_QUEUE     8 // has run, but now waiting to send to or receive from a queue
+
+// selectNextTask results, for pendSvIsr
+#define SWITCH_NONE    0 // the current task keeps running
+#define SWITCH_SAVE    1 // push the outgoing task's r4-r11, then switch
+#define SWITCH_DISCARD 2 // the outgoing task was killed: switch without writing to its stack
 
 // tcb (copied from kernel.c)
 #define NUM_PRIORITIES   8
 
+// marks the end of a task list / a task not in any list
+#define NO_TASK 0xFF
+
+// cpu stats (clock.c): cycles per window and decayed averages in fixed point
+#define CPU_KERNEL MAX_TASKS       // stats slot for the kernel and isrs
+#define CPU_LOAD_WINDOWS 3         // 1, 10 and 60 second averages
+#define CPU_LOAD_SHIFT 16
+#define CPU_LOAD_ONE (1 << CPU_LOAD_SHIFT) // all of the cpu
+
 struct _tcb
 {
+    // Fields are grouped by size so the struct packs without padding
     uint8_t state;                 // see STATE_ values above
-    _fn pid;                     // used to uniquely identify thread (address of task fn)
-    void *sp;                      // current stack pointer
     uint8_t priority;              // 0=highest
     uint8_t currentPriority;       // 0=highest (needed for pi)
-    uint32_t ticks;                // ticks until sleep complete
+    uint8_t sleepNext;             // next task in sleep queue (NO_TASK at end)
+    _fn pid;                     // used to uniquely identify thread (address of task fn)
+    void *sp;                      // current stack pointer
+    uint32_t *stackBase;           // lowest address of the stack allocation
+    uint32_t stackSize;            // bytes in the stack allocation
+    uint32_t stackUnused;          // bytes at the bottom still holding the paint
     uint64_t srd;                  // MPU subregion disable bits
-    char name[16];                 // name of task used in ps command
+    uint32_t roBase;               // read-only shared window base (MPU region 0)
+    uint32_t roAttr;               // read-only shared window attributes, 0 if none
+    uint32_t wakeTick;             // tickCount at which sleep completes
+    uint8_t readyNext;             // next task in ready list (NO_TASK if not ready)
+    uint8_t readyPrev;             // previous task in ready list
     uint8_t mutex;                 // index of the mutex in use or blocking the thread
     uint8_t semaphore;             // index of the semaphore that is blocking the thread
-    uint32_t cpu_time[2];          // CPU time, with two slots
+    uint8_t eventGroup;            // index of the event group the thread waits on
+    uint8_t eventOptions;          // EVENT_ options of the wait
+    uint8_t queue;                 // index of the queue the thread waits on
+    bool latencyPending;           // woken, but hasn't run since
+    uint32_t eventMask;            // bits it waits for
+    void *queueMessage;            // message a blocked sender is waiting to queue
+    char name[16];                 // name of task used in ps command
+    uint8_t heapQuota;             // most heap blocks the task may own, stack included (0 = no limit)
+    uint8_t heapBlocks;            // heap blocks owned now
+    uint8_t heapPeak;              // most heap blocks owned at once
+    uint32_t allocs;               // successful allocations
+    uint32_t frees;
+    uint32_t allocFailures;        // out of memory or over quota
+    uint32_t switches;             // times switched in
+    uint32_t svcCalls;             // svc calls made
+    uint32_t readyCycles;          // cycle count when last woken
+    uint32_t latencyMin;           // wake to run latency in cycles
+    uint32_t latencyMax;
+    uint32_t latencySamples;
+    uint64_t latencySum;
 } tcb[MAX_TASKS];
 
 // mutex
@@ -90,62 +165,174 @@ typedef struct _semaphore
 } semaphore;
 semaphore semaphores[MAX_SEMAPHORES];
 
-typedef struct _uartData 
+// event group
+typedef struct _eventGroup
+{
+    uint32_t flags;
+    uint16_t waiters;              // bit per task blocked on the group
+} eventGroup;
+eventGroup eventGroups[MAX_EVENT_GROUPS];
+
+// message queue: a ring of pointers, so messages are never copied
+typedef struct _msgQueue
+{
+    uint8_t depth;                 // capacity, 0 until initQueue
+    uint8_t count;                 // messages queued
+    uint8_t head;                  // slot of the oldest message
+    uint8_t highWater;             // most messages ever queued
+    uint8_t owned;                 // bit per slot holding an allocation in transit (kernel owned)
+    uint16_t senders;              // bit per task blocked on a full queue
+    uint16_t receivers;            // bit per task blocked on an empty queue
+    void *messages[MAX_QUEUE_DEPTH];
+} msgQueue;
+msgQueue queues[MAX_QUEUES];
+
+// uart0 buffer counters, kept since reset
+typedef struct _uartStats
 {
-    bool isRxFull;
-    bool isRxEmpty;
-    bool isTxFull;
-    bool isTxEmpty;
-    
-    uint32_t error;
-    uint8_t value;
-} uartData;
+    uint16_t txHighWater; // most bytes ever queued for tx
+    uint16_t rxHighWater; // longest line ever typed
+    uint32_t txDropped;   // bytes kernel handlers could not queue
+    uint32_t rxDropped;   // bytes received while the rx ring was full
+    uint32_t rxErrors;    // bytes received with overrun, break, parity or framing errors
+} uartStats;
+
+// ps snapshot, copied out by the ps svc call and formatted by the caller
+typedef struct _psTask
+{
+    _fn pid;
+    char name[16];
+    uint8_t state;
+    uint8_t mutex;                 // valid while STATE_BLOCKED_MUTEX
+    uint8_t semaphore;             // valid while STATE_BLOCKED_SEMAPHORE
+    uint8_t eventGroup;            // valid while STATE_BLOCKED_EVENT
+    uint8_t queue;                 // valid while STATE_BLOCKED_QUEUE
+    uint32_t sleepTicks;           // valid while STATE_DELAYED
+    uint32_t cpuTime;              // cycles run in the last finished window
+    uint32_t cpuLoad[CPU_LOAD_WINDOWS]; // share of the cpu, CPU_LOAD_ONE = all of it
+    uint32_t switches;
+    uint32_t svcCalls;
+    uint32_t latencyMin;           // wake to run latency in cycles
+    uint32_t latencyMax;
+    uint32_t latencySamples;
+    uint64_t latencySum;
+    uint32_t stackSize;            // bytes allocated
+    uint32_t stackPeak;            // most bytes used since the stack was painted
+    uint8_t heapQuota;             // heap blocks, 0 = no limit
+    uint8_t heapBlocks;
+    uint8_t heapPeak;
+    uint32_t allocs;
+    uint32_t frees;
+    uint32_t allocFailures;
+} psTask;
+
+typedef struct _psData
+{
+    uint8_t taskCount;
+    uint32_t windowCycles;         // length of the window cpuTime covers
+    uint32_t kernelCpuTime;        // measured in svc calls, isrs and pendsv
+    uint32_t kernelCpuLoad[CPU_LOAD_WINDOWS];
+    uint16_t heapFree;             // free heap bytes
+    uint16_t heapLargest;          // largest allocation that would succeed
+    uint8_t heapFragmentation;     // percent of free heap outside the largest block
+    uint16_t kernelStackSize;      // MSP stack, used by the kernel, ISRs and main
+    uint16_t kernelStackPeak;
+    psTask tasks[MAX_TASKS];
+} psData;
+
+// ipcs snapshot, copied out by the ipcs svc call and formatted by the caller
+typedef struct _ipcsData
+{
+    mutex mutexes[MAX_MUTEXES];
+    semaphore semaphores[MAX_SEMAPHORES];
+    eventGroup eventGroups[MAX_EVENT_GROUPS];
+    uint32_t eventMasks[MAX_TASKS]; // what each event group waiter waits for
+    msgQueue queues[MAX_QUEUES];
+    char taskNames[MAX_TASKS][16]; // resolves lockedBy and the wait queues
+    uartStats uart;
+} ipcsData;
+
+// meminfo snapshot, copied out by the meminfo svc call and formatted by the caller
+#define MAX_HEAP_ALLOCATIONS 28 // one per heap block at most (MAX_BLOCKS in mm.h)
+
+typedef struct _memAllocation
+{
+    uint32_t address;
+    uint16_t size;                 // bytes
+    uint8_t owner;                 // task number, NO_TASK for the kernel
+    uint16_t sharers;              // task number bits, see shareHeap
+    uint16_t writers;
+} memAllocation;
+
+// how reallocHeap calls were served
+typedef struct _reallocCounts
+{
+    uint32_t inPlace;              // shrunk, or grown into free buddies without copying
+    uint32_t moved;                // copied to a new allocation
+    uint32_t failed;
+} reallocCounts;
+
+typedef struct _memInfoData
+{
+    uint8_t allocationCount;
+    memAllocation allocations[MAX_HEAP_ALLOCATIONS];
+    char taskNames[MAX_TASKS][16]; // empty for unused tcbs
+    uint32_t srd[MAX_TASKS];       // a set bit disables unprivileged access to that 1KiB of SRAM
+    uint32_t roBase[MAX_TASKS];    // read-only shared window
+    uint32_t roSize[MAX_TASKS];    // 0 if the task has none
+    uint16_t heapFree;
+    uint16_t heapLargest;
+    uint8_t heapFragmentation;
+    reallocCounts realloc;
+} memInfoData;
 
 extern uint8_t taskCurrent;
 
+#include "sys/svc_table.h"
+
 //-----------------------------------------------------------------------------
 // Subroutines
 //-----------------------------------------------------------------------------
 
 bool initMutex(uint8_t mutex);
 bool initSemaphore(uint8_t semaphore, uint8_t count);
+bool initEventGroup(uint8_t group, uint32_t flags);
+bool initQueue(uint8_t queue, uint8_t depth);
 
 void initRtos(void);
 void startRtos(void);
 
-bool createThread(_fn fn, const char name[], uint8_t priority, uint32_t stackBytes);
+bool createThread(_fn fn, const char name[], uint8_t priority, uint32_t stackBytes, uint8_t heapQuota);
 void killThread_impl(_fn fn);
 void restartThread_impl(_fn fn);
 void setThreadPriority_impl(_fn fn, uint8_t priority);
+void setHeapQuota_impl(_fn fn, uint8_t blocks);
 
-void yield(void);
-void sleep(uint32_t tick);
-void wait(int8_t semaphore);
-void post(int8_t semaphore);
-void lock(int8_t mutex);
-void unlock(int8_t mutex);
-void reboot();
-void ps();
-void ipcs();
-void kill(_fn fn);
-void pkill(char *proc_name, uint32_t size);
-void pi(bool on);
-void preempt(bool on);
-void sched(bool prio_on);
-void pidof(char *, uint32_t);
-void run(char *, uint32_t);
-void killThread(_fn fn);
-void restartThread(_fn fn);
-void setThreadPriority(_fn fn, uint8_t priority);
-
-void readUart(uartData *);
+// svc call stubs (yield, sleep, lock, ...)
+SVC_TABLE(SVC_PROTOTYPE)
 
 void triggerPendSv(void);
 
-bool ensurePointer(void *, uint32_t);
+void addReadyTask(uint8_t task);
+void removeReadyTask(uint8_t task);
+void setCurrentPriority(uint8_t task, uint8_t priority);
+void setTaskResult(uint8_t task, uint32_t result);
+
+void addSleepingTask(uint8_t task, uint32_t ticks);
+void removeSleepingTask(uint8_t task);
+uint32_t getSleepTicksLeft(uint8_t task);
+
+void advanceTicks(uint32_t ticks);
+void syncTicks(void);
+
+int32_t ensurePointer(void *, uint32_t, bool);
+
+void recordWakeLatency(uint8_t task);
+
+uint8_t selectNextTask(void);
+void *switchTask(void *sp);
 
 void systickIsr(void);
-void pendSvIsr(void);
-void svCallIsr(void);
+void pendSvIsr(void); // asm.s
 
 #endif
@@ -26,33 +26,96 @@
 #include "sys/kernel.h"
 
 #define MAX_BLOCKS 28
+#define FLASH_TOP 0x00040000
 #define SRAM_BASE 0x20000000
+#define SRAM_SIZE 0x8000
 #define HEAP_BASE 0x20001000
 #define HEAP_TOP 0x20008000
 #define BLOCK_SIZE 0x400
 
+// Largest single allocation. Buddy blocks are aligned to their own size from
+// SRAM_BASE, and the kernel's first 4KiB splits the heap into 4, 8 and 16KiB
+// blocks, so one allocation is at most 16KiB even with all 28KiB free.
+#define MAX_ALLOC_SIZE (16*BLOCK_SIZE)
+
+#define STACK_PAINT 0xA5A5A5A5
+
 typedef struct heap_block
 {
     bool isUsed; //Whether block is currently allocated or not
     _fn pid; //PID of owner of this region
     uint16_t len; //Length of allocation (only nonzero for initial block)
+    uint16_t sharers; //Task number bits of tasks the owner shared this with
+    uint16_t writers; //Subset of sharers with read-write access
 } heap_block;
 
+#define MAX_POOLS 4
+#define MAX_POOL_BLOCKS 64
+
+typedef struct mem_pool
+{
+    uint8_t *base; //Start of the pool's heap allocation (NULL if unused)
+    uint16_t blockSize; //Size of each block in bytes
+    uint8_t blockCount; //Number of blocks
+    uint8_t owner; //Task number of owner (NO_TASK for the kernel)
+    uint8_t freeTop; //Number of indices on freeStack
+    uint8_t freeStack[MAX_POOL_BLOCKS]; //Indices of free blocks
+    uint64_t allocated; //Bit per block, set while allocated
+} mem_pool;
+
 void mpu_init();
 
 void removeSramAccessWindow(uint64_t *, uint32_t *, uint32_t );
 void addSramAccessWindow(uint64_t *, uint32_t *, uint32_t);
 uint64_t createNoSramAccessMask(void);
 void applySramAccessMask(uint64_t);
+void applyReadOnlyWindow(uint32_t base, uint32_t attr);
 void cleanupTaskMemory(uint8_t);
 
+void addHeapUsage(uint8_t taskNum, uint8_t blocks);
 void * mallocMemory(uint32_t, uint8_t);
 void * mallocHeap_impl(uint32_t);
-void freeHeap_impl(void *);
+void freeHeap_impl(void *, uint32_t);
+bool canGrowInPlace(uint8_t block, uint8_t order, uint8_t newOrder);
+void resizeInPlace(uint8_t index, uint8_t newOrder, uint8_t taskNum);
+void * reallocHeap_impl(void *ptr, uint32_t size_in_bytes);
+void freeMemory(uint8_t index, uint8_t taskNum);
+
+void paintStack(uint32_t *base, uint32_t size);
+void paintKernelStack(void);
+uint32_t getStackPeak(uint8_t task);
+uint32_t getKernelStackSize(void);
+uint32_t getKernelStackPeak(void);
+
+void removeSharer(uint8_t index, uint8_t taskNum);
+void revokeSharers(uint8_t index);
+void transferOwnership(uint8_t index, uint8_t taskNum);
+int32_t shareHeap_impl(void *ptr, char *name, uint32_t size, bool writable);
+
+bool detachAllocation(void *ptr, uint8_t taskNum);
+void attachAllocation(void *ptr, uint8_t taskNum);
+
+int8_t createMemoryPool(uint8_t taskNum, uint16_t blockSize, uint8_t blockCount);
+void * allocPoolBlock(int8_t pool);
+bool freePoolBlock(int8_t pool, void *ptr);
+void destroyMemoryPool(int8_t pool);
+int8_t getPoolByBase(void *base);
+
+int32_t createPool_impl(uint32_t blockSize, uint32_t blockCount);
+void * allocPool_impl(int8_t pool);
+void freePool_impl(int8_t pool, void *ptr);
+void destroyPool_impl(int8_t pool);
 void initMemoryManager(void);
+
+uint32_t getFreeHeap(void);
+uint32_t getLargestFreeBlock(void);
+uint8_t getHeapFragmentation(void);
+void memInfo_impl(memInfoData *data);
 void initMpu(void);
 
 uint32_t getHeapIndex(void *addr);
+// Returns size in bytes of the allocation starting at base
+uint32_t getAllocationSize(void *base);
 // Returns task id of task that owns the given memory
 _fn getMemoryOwner(void *addr);
 
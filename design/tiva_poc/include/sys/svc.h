@@ -8,48 +8,33 @@
 #include "sys/kernel.h"
 #include "util/interface.h"
 
-// svc call numbers
-#define SVC_YIELD (uint8_t)0
-#define SVC_SLEEP (uint8_t)1
-#define SVC_LOCK (uint8_t)2
-#define SVC_UNLOCK (uint8_t)3
-#define SVC_WAIT (uint8_t)4
-#define SVC_POST (uint8_t)5
+// svc call numbers (SVC_YIELD, SVC_SLEEP, ...)
+enum svc_number
+{
+    SVC_TABLE(SVC_NUMBER)
+    SVC_COUNT
+};
 
-#define SVC_READUART (uint8_t)6
-#define SVC_WRITE (uint8_t)7
-#define SVC_REBOOT (uint8_t)8
-#define SVC_PS (uint8_t)9
-#define SVC_IPCS (uint8_t)10
-#define SVC_KILL (uint8_t)11
-#define SVC_PKILL (uint8_t)12
-#define SVC_PI (uint8_t)13
-#define SVC_PREEMPT (uint8_t)14
-#define SVC_SCHED (uint8_t)15
-#define SVC_PIDOF (uint8_t)16
-#define SVC_RUN (uint8_t)17
-#define SVC_MALLOC (uint8_t)18
-#define SVC_FREE (uint8_t)19
-#define SVC_KILLTHREAD (uint8_t)20
-#define SVC_RESTARTTHREAD (uint8_t)21
-#define SVC_SETTHREADPRIORITY (uint8_t)22
+// kernel side of an svc call: a thunk that unpacks the stacked r0-r3 into its
+// handler's arguments and stores the result back in the stacked r0
+typedef void (*svc_handler)(uint32_t *frame);
 
-union svc_param {
-    uint8_t uint8;
-    uint32_t uint32;
-    _fn fn;
-    void *voidPtr;
-    char *str;
-    bool boolVal;
-    USER_DATA *readData;
-    uartData *uart;
-};
+// pointer or index argument to validate before dispatch
+typedef struct _svc_check
+{
+    uint8_t ptrArg;     // register holding the pointer (SVC_NO_ARG if none)
+    uint8_t sizeArg;    // register holding its length (SVC_NO_ARG if fixed)
+    uint16_t size;      // fixed length, or bytes past the register length
+    bool input;         // only read by the handler
+    uint8_t indexArg;   // register holding a kernel table index (SVC_NO_ARG if none)
+    uint8_t indexCount; // entries in that table
+} svc_check;
 
-union svc_param2
+typedef struct _svc_entry
 {
-    uint32_t size;
-    uint8_t priority;
-};
+    svc_handler handler;
+    svc_check check;
+} svc_entry;
 
 uint8_t dequeue(uint8_t *, uint8_t *, uint8_t);
 
@@ -59,21 +44,38 @@ void lock_impl(uint8_t);
 void unlock_impl(uint8_t);
 void wait_impl(uint8_t);
 void post_impl(uint8_t);
+uint32_t matchEvents(uint32_t, uint32_t, uint8_t);
+uint32_t waitEvents_impl(uint8_t, uint32_t, uint8_t);
+void setEvents_impl(uint8_t, uint32_t);
+uint32_t clearEvents_impl(uint8_t, uint32_t);
+uint8_t pickQueueWaiter(uint16_t);
+void removeQueueWaiter(uint8_t);
+void wakeQueueWaiter(uint8_t, uint32_t);
+void timeoutQueueWait(uint8_t);
+bool deliverMessage(uint8_t, void *, uint8_t);
+void blockOnQueue(uint8_t, uint32_t);
+bool sendQueueFromIsr(uint8_t, void *);
+int32_t sendQueue_impl(uint8_t, void *, uint32_t);
+void * receiveQueue_impl(uint8_t, uint32_t);
 
 // Shell functions
-void readUart_impl(uartData *);
-void write_impl(char *);
+int32_t readLine_impl(char *, uint32_t);
+int32_t write_impl(char *, uint32_t);
 void reboot_impl(void);
-void ps_impl(void);
-void ipcs_impl(void);
+void ps_impl(psData *);
+void ipcs_impl(ipcsData *);
 void kill_impl(_fn);
-void pkill_impl(char *);
+void pkill_impl(char *, uint32_t);
 void pi_impl(bool);
 void preempt_impl(bool);
 void sched_impl(bool);
-void pidof_impl(char *);
-void run_impl(char *name);
-void mallocHeap(uint32_t);
-void freeHeap(void *, uint32_t);
+void tickless_impl(bool);
+void pidof_impl(char *, uint32_t);
+void run_impl(char *name, uint32_t size);
+void resetStats_impl(void);
+uint32_t cycles_impl(void);
+
+void callSvc(uint32_t *frame);
+void svCallIsr(void);
 
 #endif
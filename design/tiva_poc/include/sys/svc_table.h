@@ -0,0 +1,141 @@
+// Ahmed Abdulla
+// Copyright 2025 Ahmed Abdulla. All Rights Reserved.
+// (Excluding work produced by Professor Jason Losh)
+//
+// SVC call table
+// Every svc call is declared once here. The table generates the SVC_ numbers
+// (svc.h), the user stub prototypes (kernel.h), the user stubs (kernel.c), and
+// a typed thunk per call with the dispatch table and its pointer checks (svc.c).
+
+#ifndef SYS_SVC_TABLE_H
+#define SYS_SVC_TABLE_H
+
+// Row layout: X(number, ID, stub, handler, return, params, check)
+//   number  - svc immediate and dispatch table index (rows must stay contiguous)
+//   ID      - names the SVC_<ID> number
+//   stub    - user-mode function that issues the svc
+//   handler - kernel function called with the stacked r0-r3, converted to the params
+//   return  - void, or a value type from SVC_TYPE_ below, written back into r0
+//   params  - (type, name) per register r0-r3, or ((void)) for none
+//   check   - SVC_CHECK_ descriptor of the pointer or index argument validated before dispatch
+#define SVC_TABLE(X) \
+    X(0,  YIELD,             yield,             yield_impl,             void, ((void)),                                          SVC_CHECK_NONE) \
+    X(1,  SLEEP,             sleep,             sleep_impl,             void, ((uint32_t, tick)),                                SVC_CHECK_NONE) \
+    X(2,  LOCK,              lock,              lock_impl,              void, ((int8_t, mutex)),                                 SVC_CHECK_INDEX(0, MAX_MUTEXES)) \
+    X(3,  UNLOCK,            unlock,            unlock_impl,            void, ((int8_t, mutex)),                                 SVC_CHECK_INDEX(0, MAX_MUTEXES)) \
+    X(4,  WAIT,              wait,              wait_impl,              void, ((int8_t, semaphore)),                             SVC_CHECK_INDEX(0, MAX_SEMAPHORES)) \
+    X(5,  POST,              post,              post_impl,              void, ((int8_t, semaphore)),                             SVC_CHECK_INDEX(0, MAX_SEMAPHORES)) \
+    X(6,  READLINE,          readLine,          readLine_impl,          i32,  ((char *, str), (uint32_t, size)),                 SVC_CHECK_BUFFER(0, 1)) \
+    X(7,  WRITE,             write,             write_impl,             i32,  ((char *, str), (uint32_t, size)),                 SVC_CHECK_INPUT(0, 1)) \
+    X(8,  REBOOT,            reboot,            reboot_impl,            void, ((void)),                                          SVC_CHECK_NONE) \
+    X(9,  PS,                ps,                ps_impl,                void, ((psData *, data)),                                SVC_CHECK_OBJECT(0, psData)) \
+    X(10, IPCS,              ipcs,              ipcs_impl,              void, ((ipcsData *, data)),                              SVC_CHECK_OBJECT(0, ipcsData)) \
+    X(11, KILL,              kill,              kill_impl,              void, ((_fn, fn)),                                       SVC_CHECK_NONE) \
+    X(12, PKILL,             pkill,             pkill_impl,             void, ((char *, proc_name), (uint32_t, size)),           SVC_CHECK_STRING(0, 1)) \
+    X(13, PI,                pi,                pi_impl,                void, ((bool, on)),                                      SVC_CHECK_NONE) \
+    X(14, PREEMPT,           preempt,           preempt_impl,           void, ((bool, on)),                                      SVC_CHECK_NONE) \
+    X(15, SCHED,             sched,             sched_impl,             void, ((bool, prio_on)),                                 SVC_CHECK_NONE) \
+    X(16, PIDOF,             pidof,             pidof_impl,             void, ((char *, proc_name), (uint32_t, size)),           SVC_CHECK_STRING(0, 1)) \
+    X(17, RUN,               run,               run_impl,               void, ((char *, name), (uint32_t, size)),                SVC_CHECK_STRING(0, 1)) \
+    X(18, MALLOC,            mallocHeap,        mallocHeap_impl,        ptr,  ((uint32_t, size_in_bytes)),                       SVC_CHECK_NONE) \
+    X(19, FREE,              freeHeap,          freeHeap_impl,          void, ((void *, ptr), (uint32_t, size)),                 SVC_CHECK_BUFFER(0, 1)) \
+    X(20, KILLTHREAD,        killThread,        killThread_impl,        void, ((_fn, fn)),                                       SVC_CHECK_NONE) \
+    X(21, RESTARTTHREAD,     restartThread,     restartThread_impl,     void, ((_fn, fn)),                                       SVC_CHECK_NONE) \
+    X(22, SETTHREADPRIORITY, setThreadPriority, setThreadPriority_impl, void, ((_fn, fn), (uint8_t, priority)),                  SVC_CHECK_INDEX(1, NUM_PRIORITIES)) \
+    X(23, TICKLESS,          tickless,          tickless_impl,          void, ((bool, on)),                                      SVC_CHECK_NONE) \
+    X(24, RESETSTATS,        resetStats,        resetStats_impl,        void, ((void)),                                          SVC_CHECK_NONE) \
+    X(25, CREATEPOOL,        createPool,        createPool_impl,        i32,  ((uint32_t, blockSize), (uint32_t, blockCount)),   SVC_CHECK_NONE) \
+    X(26, ALLOCPOOL,         allocPool,         allocPool_impl,         ptr,  ((int8_t, pool)),                                  SVC_CHECK_NONE) \
+    X(27, FREEPOOL,          freePool,          freePool_impl,          void, ((int8_t, pool), (void *, ptr)),                   SVC_CHECK_NONE) \
+    X(28, DESTROYPOOL,       destroyPool,       destroyPool_impl,       void, ((int8_t, pool)),                                  SVC_CHECK_NONE) \
+    X(29, SHAREHEAP,         shareHeap,         shareHeap_impl,         i32,  ((void *, ptr), (char *, name), (uint32_t, size), (bool, writable)), SVC_CHECK_STRING(1, 2)) \
+    X(30, MEMINFO,           memInfo,           memInfo_impl,           void, ((memInfoData *, data)),                           SVC_CHECK_OBJECT(0, memInfoData)) \
+    X(31, SETHEAPQUOTA,      setHeapQuota,      setHeapQuota_impl,      void, ((_fn, fn), (uint8_t, blocks)),                    SVC_CHECK_NONE) \
+    X(32, REALLOC,           reallocHeap,       reallocHeap_impl,       ptr,  ((void *, ptr), (uint32_t, size_in_bytes)),        SVC_CHECK_NONE) \
+    X(33, CYCLES,            cycles,            cycles_impl,            u32,  ((void)),                                          SVC_CHECK_NONE) \
+    X(34, WAITEVENTS,        waitEvents,        waitEvents_impl,        u32,  ((int8_t, group), (uint32_t, mask), (uint8_t, options)), SVC_CHECK_NONE) \
+    X(35, SETEVENTS,         setEvents,         setEvents_impl,         void, ((int8_t, group), (uint32_t, mask)),               SVC_CHECK_NONE) \
+    X(36, CLEAREVENTS,       clearEvents,       clearEvents_impl,       u32,  ((int8_t, group), (uint32_t, mask)),               SVC_CHECK_NONE) \
+    X(37, SENDQUEUE,         sendQueue,         sendQueue_impl,         i32,  ((int8_t, queue), (void *, message), (uint32_t, timeout)), SVC_CHECK_NONE) \
+    X(38, RECEIVEQUEUE,      receiveQueue,      receiveQueue_impl,      ptr,  ((int8_t, queue), (uint32_t, timeout)),            SVC_CHECK_NONE)
+
+// return types
+#define SVC_TYPE_void void
+#define SVC_TYPE_ptr  void *
+#define SVC_TYPE_u32  uint32_t
+#define SVC_TYPE_i32  int32_t
+
+// pointer and index checks, by argument register number
+// Output ranges must be writable by the caller; input ranges, which the kernel
+// only reads, may also be in flash or the caller's read-only shared window.
+// An index must be below the length of the kernel table it selects.
+#define SVC_NO_ARG 0xFF
+#define SVC_CHECK_NONE            { SVC_NO_ARG, SVC_NO_ARG, 0, false, SVC_NO_ARG, 0 }
+#define SVC_CHECK_BUFFER(p, n)    { p, n, 0, false, SVC_NO_ARG, 0 }                       // n bytes at p
+#define SVC_CHECK_INPUT(p, n)     { p, n, 0, true, SVC_NO_ARG, 0 }                        // n bytes at p, read only
+#define SVC_CHECK_STRING(p, n)    { p, n, 1, true, SVC_NO_ARG, 0 }                        // n chars at p plus the terminator
+#define SVC_CHECK_OBJECT(p, type) { p, SVC_NO_ARG, sizeof(type), false, SVC_NO_ARG, 0 }   // one type at p
+#define SVC_CHECK_INDEX(i, count) { SVC_NO_ARG, SVC_NO_ARG, 0, false, i, count }          // index at i, below count
+
+// error results (negative, so calls that check a pointer and return a value use i32)
+// A failed pointer check skips the handler and returns the error in r0.
+#define SVC_OK          0
+#define SVC_ERR_RANGE  -1 // range wraps around or leaves SRAM
+#define SVC_ERR_ACCESS -2 // range isn't all in the caller's stack, heap or shared memory
+#define SVC_ERR_ARG    -3 // index out of range, or handler rejected an argument
+#define SVC_ERR_TIMEOUT -4 // queue stayed full until the timeout
+
+// params walkers: SVC_EACH(m, params) is m(register, type, name) for each
+// (type, name), comma separated, or m(0, void) for ((void))
+#define SVC_CAT(a, b) SVC_CAT_(a, b)
+#define SVC_CAT_(a, b) a##b
+#define SVC_NARGS(...) SVC_NARGS_(__VA_ARGS__, 4, 3, 2, 1, 0)
+#define SVC_NARGS_(_1, _2, _3, _4, n, ...) n
+#define SVC_EACH(m, params) SVC_CALL(SVC_CAT(SVC_EACH_, SVC_NARGS params), (m, SVC_EXPAND params))
+#define SVC_EACH_1(m, a)          SVC_APPLY(m, 0, a)
+#define SVC_EACH_2(m, a, b)       SVC_APPLY(m, 0, a), SVC_APPLY(m, 1, b)
+#define SVC_EACH_3(m, a, b, c)    SVC_APPLY(m, 0, a), SVC_APPLY(m, 1, b), SVC_APPLY(m, 2, c)
+#define SVC_EACH_4(m, a, b, c, d) SVC_APPLY(m, 0, a), SVC_APPLY(m, 1, b), SVC_APPLY(m, 2, c), SVC_APPLY(m, 3, d)
+#define SVC_APPLY(m, reg, param) SVC_CALL_PARAM(SVC_CAT(SVC_APPLY_, SVC_NARGS param), (m, reg, SVC_EXPAND param))
+#define SVC_APPLY_1(m, reg, none) m(reg, void)
+#define SVC_APPLY_2(m, reg, type, name) m(reg, type, name)
+#define SVC_EXPAND(...) __VA_ARGS__
+#define SVC_CALL(f, args) f args        // expands args before f splits them
+#define SVC_CALL_PARAM(f, args) f args  // the same, one level down
+
+#define SVC_PARAM(reg, ...) SVC_CAT(SVC_PARAM_, SVC_NARGS(__VA_ARGS__))(__VA_ARGS__)
+#define SVC_PARAM_1(none) void
+#define SVC_PARAM_2(type, name) type name
+#define SVC_REGISTER(reg, ...) SVC_CAT(SVC_REGISTER_, SVC_NARGS(__VA_ARGS__))(reg, __VA_ARGS__)
+#define SVC_REGISTER_1(reg, none)
+#define SVC_REGISTER_2(reg, type, name) (type) frame[reg]
+
+// generated declarations
+#define SVC_NUMBER(num, id, stub, handler, ret, params, check) SVC_##id = num,
+#define SVC_PROTOTYPE(num, id, stub, handler, ret, params, check) SVC_TYPE_##ret stub(SVC_EACH(SVC_PARAM, params));
+#define SVC_DISPATCH(num, id, stub, handler, ret, params, check) [num] = { svcThunk_##id, check },
+
+// generated thunks: call the handler with the stacked r0-r3 as its own
+// types, and write any result back into the stacked r0
+#define SVC_THUNK(num, id, stub, handler, ret, params, check) \
+    static void svcThunk_##id(uint32_t *frame) { SVC_RESULT_##ret(handler(SVC_EACH(SVC_REGISTER, params))); }
+#define SVC_RESULT_void(call) call;
+#define SVC_RESULT_ptr(call)  frame[0] = (uint32_t) call;
+#define SVC_RESULT_u32(call)  frame[0] = call;
+#define SVC_RESULT_i32(call)  frame[0] = call;
+
+// generated user stubs
+// Arguments are already in r0-r3 when the svc is taken. A value-returning
+// handler's result is written into the stacked r0, which svcResult() hands back.
+#define SVC_STUB(num, id, stub, handler, ret, params, check) SVC_STUB_##ret(num, stub, params)
+#ifndef SVC_STUB_VALUE // a port may supply its own trap
+#define SVC_STUB_void(num, stub, params) \
+    void stub(SVC_EACH(SVC_PARAM, params)) { asm(" svc #" #num "\n\t"); }
+#define SVC_STUB_VALUE(type, num, stub, params) \
+    type stub(SVC_EACH(SVC_PARAM, params)) { asm(" svc #" #num "\n\t"); return (type) svcResult(); }
+#endif
+#define SVC_STUB_ptr(num, stub, params)  SVC_STUB_VALUE(void *, num, stub, params)
+#define SVC_STUB_u32(num, stub, params)  SVC_STUB_VALUE(uint32_t, num, stub, params)
+#define SVC_STUB_i32(num, stub, params)  SVC_STUB_VALUE(int32_t, num, stub, params)
+
+#endif
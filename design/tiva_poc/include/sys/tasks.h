@@ -20,6 +20,7 @@
 //-----------------------------------------------------------------------------
 
 void initHw(void);
+void initTasks(void);
 
 void idle(void);
 void flash4Hz(void);
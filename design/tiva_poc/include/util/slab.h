@@ -0,0 +1,56 @@
+// Ahmed Abdulla
+// Copyright 2025 Ahmed Abdulla. All Rights Reserved.
+// (Excluding work produced by Professor Jason Losh)
+//
+// Small object allocator
+// Carves 16-512 byte objects out of 1KiB pages the task gets from mallocHeap,
+// so MPU ownership is unchanged and alloc/free only make an svc call to take
+// a new page or give an empty one back.
+// A slabHeap belongs to one task, lives in its stack or heap, and must not be
+// shared between tasks.
+
+#ifndef UTIL_SLAB_H_
+#define UTIL_SLAB_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define SLAB_PAGE_SIZE 1024 // one heap block
+#define SLAB_MAX_PAGES 16
+#define SLAB_NUM_CLASSES 6  // 16, 32, 64, 128, 256, 512 bytes
+#define SLAB_MIN_SIZE 16
+#define SLAB_MAX_SIZE 512
+#define SLAB_NO_PAGE 0xFF
+
+// Page descriptor, kept outside the page so every byte of it holds objects
+typedef struct _slabPage
+{
+    uint8_t *base;      // page from mallocHeap, NULL if the descriptor is unused
+    uint8_t sizeClass;  // objects are SLAB_MIN_SIZE << sizeClass bytes
+    uint8_t freeCount;
+    uint8_t freeHead;   // first free object; each free object holds the next index
+} slabPage;
+
+typedef struct _slabHeap
+{
+    slabPage pages[SLAB_MAX_PAGES];
+    uint8_t partial[SLAB_NUM_CLASSES]; // page of each class with free objects, or SLAB_NO_PAGE
+} slabHeap;
+
+// Occupancy of a slabHeap, per size class
+typedef struct _slabStats
+{
+    uint8_t pages[SLAB_NUM_CLASSES];     // pages held
+    uint16_t used[SLAB_NUM_CLASSES];     // objects handed out
+    uint16_t capacity[SLAB_NUM_CLASSES]; // objects the held pages fit
+    uint32_t bytesUsed;                  // object bytes handed out
+    uint32_t bytesHeld;                  // page bytes taken from the heap
+} slabStats;
+
+void initSlabHeap(slabHeap *heap);
+void *slabAlloc(slabHeap *heap, uint32_t size);
+void slabFree(slabHeap *heap, void *ptr);
+void trimSlabHeap(slabHeap *heap);
+void getSlabStats(const slabHeap *heap, slabStats *stats);
+
+#endif
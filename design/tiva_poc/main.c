@@ -62,6 +62,7 @@ int main(void)
     // Initialize hardware
     initSystemClockTo40Mhz();
     initHw();
+    initTasks();
     initUart0();
     enable_faults();
 
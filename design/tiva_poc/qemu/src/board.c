@@ -0,0 +1,97 @@
+// Ahmed Abdulla
+// Copyright 2025 Ahmed Abdulla. All Rights Reserved.
+// (Excluding work produced by Professor Jason Losh)
+//
+// Board timers and UART pins, QEMU lm3s6965evb
+// Replaces src/boot/board.c. The LM3S6965 has no DWT cycle counter or wide
+// timers in QEMU, so cycles come from SysTick and the window from Timer 0A.
+// It also has no RCGCUART, GPIO PCTL or UARTCC, so UART0 is brought up
+// through the legacy clock gates and AFSEL alone.
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target uC:       LM3S6965 (Cortex-M3), as modelled by qemu-system-arm
+// System Clock:    40 MHz
+
+//-----------------------------------------------------------------------------
+// Device includes, defines, and assembler directives
+//-----------------------------------------------------------------------------
+
+#include <stdint.h>
+#include "tm4c123gh6pm.h"
+#include "sys/clock.h"
+#include "sys/kernel.h"
+#include "io/uart0.h"
+
+#define WINDOW_CYCLES 40000000 // 1 second at 40MHz
+
+// PortA masks
+#define UART_TX_MASK 2
+#define UART_RX_MASK 1
+
+extern uint32_t tickCount;
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+// SysTick is the counter; nothing to enable
+void initCycleCounter(void)
+{
+}
+
+// Cycles since SysTick started: whole ticks plus the count into this one.
+// Needs a fixed reload, so tickless idle must stay off on this board.
+uint32_t getCycleCount(void)
+{
+    uint32_t pending, ticks, current, period;
+
+    // Retry if the tick ends between the reads
+    do
+    {
+        pending = NVIC_INT_CTRL_R & NVIC_INT_CTRL_PENDSTSET;
+        ticks = tickCount;
+        current = NVIC_ST_CURRENT_R;
+    } while (pending != (NVIC_INT_CTRL_R & NVIC_INT_CTRL_PENDSTSET) || ticks != tickCount);
+
+    // A tick that has ended but isn't counted yet
+    if (pending) ticks++;
+
+    period = NVIC_ST_RELOAD_R + 1;
+    return ticks*period + (period - 1 - current);
+}
+
+// Timer 0A, 32-bit periodic every second, calls wTimer0AIsr (interrupt 19)
+void initWindowTimer(void)
+{
+    SYSCTL_RCGC1_R |= SYSCTL_RCGC1_TIMER0;
+    NVIC_EN0_R |= 1 << 19;
+    //Touches tcb, so runs at kernel priority
+    NVIC_PRI4_R = (NVIC_PRI4_R & ~NVIC_PRI4_INTD_M) | ((uint32_t)KERNEL_INT_PRIORITY << 29);
+
+    TIMER0_CTL_R &= ~TIMER_CTL_TAEN;
+    TIMER0_CFG_R = TIMER_CFG_32_BIT_TIMER;
+    TIMER0_TAMR_R = TIMER_TAMR_TAMR_PERIOD;
+    TIMER0_TAILR_R = WINDOW_CYCLES - 1;
+    TIMER0_IMR_R |= TIMER_IMR_TATOIM;
+    TIMER0_CTL_R |= TIMER_CTL_TAEN;
+}
+
+void clearWindowTimer(void)
+{
+    TIMER0_ICR_R = TIMER_ICR_TATOCINT;
+}
+
+// UART0 on PA0 (U0RX) and PA1 (U0TX): AFSEL hands the pins to UART0, which
+// always runs from the system clock
+void initUart0Board(void)
+{
+    SYSCTL_RCGC1_R |= SYSCTL_RCGC1_UART0;
+    SYSCTL_RCGC2_R |= SYSCTL_RCGC2_GPIOA;
+    _delay_cycles(3);
+
+    GPIO_PORTA_DEN_R |= UART_TX_MASK | UART_RX_MASK;
+    GPIO_PORTA_AFSEL_R |= UART_TX_MASK | UART_RX_MASK;
+}
@@ -0,0 +1,449 @@
+// Ahmed Abdulla
+// Copyright 2025 Ahmed Abdulla. All Rights Reserved.
+// (Excluding work produced by Professor Jason Losh)
+//
+// Rhealstone suite
+// Runs the Rhealstone measurements on the unmodified kernel under QEMU and
+// prints one line per metric on UART0:
+//   rhealstone <metric> samples=<n> min=<cycles> avg=<cycles> max=<cycles>
+// followed by "rhealstone done", after which the board reboots (and QEMU,
+// started with -no-reboot, exits).
+//
+// Tasks are unprivileged and can't read each other's globals, so each phase
+// is a set of tasks that take their samples on their own stacks and print
+// them, or leave them in the kernel's wake latency counters for the Suite
+// task to read back through ps.
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target uC:       LM3S6965 (Cortex-M3), as modelled by qemu-system-arm
+// System Clock:    40 MHz
+
+//-----------------------------------------------------------------------------
+// Device includes, defines, and assembler directives
+//-----------------------------------------------------------------------------
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "tm4c123gh6pm.h"
+#include "sys/clock.h"
+#include "sys/kernel.h"
+#include "sys/svc.h"
+#include "sys/mm.h"
+#include "sys/asm.h"
+#include "io/uart0.h"
+#include "util/str.h"
+
+// semaphores (the key and flash semaphores have no hardware here)
+#define pingSem keyPressed
+#define pongSem keyReleased
+
+// queue the Waiter receives on
+#define wakeQueue 0
+
+// software triggered interrupts (startup_qemu.c)
+#define LATENCY_IRQ 25
+#define WAKE_IRQ 26
+
+#define SAMPLES 100
+
+// busy loop Mid runs, long enough to show up if priority inheritance fails
+#define MID_SPIN 10000
+
+typedef struct _sampleStats
+{
+    uint32_t samples;
+    uint32_t min;
+    uint32_t max;
+    uint64_t sum;
+} sampleStats;
+
+// suite.s
+extern uint32_t triggerInterrupt(uint32_t stamp, uint32_t irq);
+
+// tasks, which kill their partners by pid
+void switchB(void);
+void spinner(void);
+void ponger(void);
+void high(void);
+void mid(void);
+void low(void);
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+void clearSamples(sampleStats *stats)
+{
+    stats->samples = 0;
+    stats->min = UINT32_MAX;
+    stats->max = 0;
+    stats->sum = 0;
+}
+
+void addSample(sampleStats *stats, uint32_t cycles)
+{
+    if (cycles < stats->min) stats->min = cycles;
+    if (cycles > stats->max) stats->max = cycles;
+    stats->sum += cycles;
+    stats->samples++;
+}
+
+void reportSamples(char *metric, sampleStats *stats)
+{
+    if (stats->samples == 0) stats->min = 0;
+
+    putsUart0("rhealstone ");
+    putsUart0(metric);
+    putsUart0(" samples=");
+    putIntUart0(stats->samples);
+    putsUart0(" min=");
+    putIntUart0(stats->min);
+    putsUart0(" avg=");
+    putIntUart0(stats->samples ? (uint32_t)(stats->sum / stats->samples) : 0);
+    putsUart0(" max=");
+    putIntUart0(stats->max);
+    putsUart0("\n");
+}
+
+// Cost of the cycles svc itself, taken off every pair of readings
+uint32_t getTimerOverhead(void)
+{
+    uint32_t t0, t1, best = UINT32_MAX;
+    uint8_t i;
+
+    for (i = 0; i < 8; i++)
+    {
+        t0 = cycles();
+        t1 = cycles();
+        if (t1 - t0 < best) best = t1 - t0;
+    }
+
+    return best;
+}
+
+uint32_t removeOverhead(uint32_t cycles, uint32_t overhead)
+{
+    return cycles > overhead ? cycles - overhead : 0;
+}
+
+// Copies the wake latency the kernel measured for a task
+void readWakeLatency(char *name, sampleStats *stats)
+{
+    psData data;
+    uint8_t i;
+
+    clearSamples(stats);
+    ps(&data);
+
+    for (i = 0; i < data.taskCount; i++)
+    {
+        if (_strcmp(data.tasks[i].name, name) != 0) continue;
+
+        stats->samples = data.tasks[i].latencySamples;
+        stats->min = data.tasks[i].latencyMin;
+        stats->max = data.tasks[i].latencyMax;
+        stats->sum = data.tasks[i].latencySum;
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Interrupts
+//-----------------------------------------------------------------------------
+
+// Priority 0, above the kernel. Replaces the stamp triggerInterrupt left in
+// the interrupted task's r0 with the cycles since it was taken.
+void latencyIsr(void)
+{
+    uint32_t *frame = getPsp();
+
+    frame[0] = getCycleCount() - frame[0];
+}
+
+// Kernel priority: wakes Waiter with an empty message, as a driver isr would
+void wakeIsr(void)
+{
+    sendQueueFromIsr(wakeQueue, NULL);
+    triggerPendSv();
+}
+
+//-----------------------------------------------------------------------------
+// Tasks
+//-----------------------------------------------------------------------------
+
+void idle(void)
+{
+    while (true) yield();
+}
+
+// task_switch: two tasks at one priority handing over with yield
+void switchA(void)
+{
+    const uint32_t overhead = getTimerOverhead();
+    sampleStats stats;
+    uint32_t t0, t1;
+
+    clearSamples(&stats);
+    while (stats.samples < SAMPLES)
+    {
+        t0 = cycles();
+        yield();
+        t1 = cycles();
+        addSample(&stats, removeOverhead(t1 - t0, overhead) / 2);
+    }
+
+    reportSamples("task_switch", &stats);
+    killThread(switchB);
+    killThread(switchA);
+}
+
+void switchB(void)
+{
+    while (true) yield();
+}
+
+// preemption_time: Sleeper wakes on the tick and preempts Spinner
+void sleeper(void)
+{
+    uint8_t i;
+
+    for (i = 0; i < SAMPLES; i++) sleep(1);
+
+    killThread(spinner);
+    killThread(sleeper);
+}
+
+void spinner(void)
+{
+    while (true);
+}
+
+// interrupt_task_latency and message_latency: woken through wakeQueue,
+// freeing any buffer the message hands over
+void waiter(void)
+{
+    void *message;
+
+    while (true)
+    {
+        message = receiveQueue(wakeQueue, QUEUE_FOREVER);
+        if (message) freeHeap(message, BLOCK_SIZE);
+    }
+}
+
+// semaphore_shuffle: a post wakes Ponger, whose post wakes Pinger
+void pinger(void)
+{
+    const uint32_t overhead = getTimerOverhead();
+    sampleStats stats;
+    uint32_t t0, t1;
+
+    clearSamples(&stats);
+    while (stats.samples < SAMPLES)
+    {
+        t0 = cycles();
+        post(pingSem);
+        wait(pongSem);
+        t1 = cycles();
+        addSample(&stats, removeOverhead(t1 - t0, overhead) / 2);
+    }
+
+    reportSamples("semaphore_shuffle", &stats);
+    killThread(ponger);
+    killThread(pinger);
+}
+
+void ponger(void)
+{
+    while (true)
+    {
+        wait(pingSem);
+        post(pongSem);
+    }
+}
+
+// deadlock_break: High blocks on the mutex Low holds while Mid is ready.
+// With priority inheritance Low runs ahead of Mid and hands the mutex over.
+void high(void)
+{
+    const uint32_t overhead = getTimerOverhead();
+    sampleStats stats;
+    uint32_t t0, t1;
+
+    clearSamples(&stats);
+    while (true)
+    {
+        wait(pingSem);
+        t0 = cycles();
+        lock(resource);
+        t1 = cycles();
+        unlock(resource);
+        addSample(&stats, removeOverhead(t1 - t0, overhead));
+
+        if (stats.samples == SAMPLES) reportSamples("deadlock_break", &stats);
+    }
+}
+
+void mid(void)
+{
+    volatile uint32_t i;
+
+    while (true)
+    {
+        wait(pongSem);
+        for (i = 0; i < MID_SPIN; i++);
+    }
+}
+
+void low(void)
+{
+    uint8_t i;
+
+    for (i = 0; i < SAMPLES; i++)
+    {
+        lock(resource);
+        post(pongSem);
+        post(pingSem);
+        yield();
+        unlock(resource);
+        yield();
+    }
+
+    killThread(high);
+    killThread(mid);
+    killThread(low);
+}
+
+// Starts a phase's tasks and returns once they have all blocked or died.
+// Stats are cleared after the restarts so their first run isn't a sample.
+void runPhase(_fn a, _fn b, _fn c)
+{
+    if (a) restartThread(a);
+    if (b) restartThread(b);
+    if (c) restartThread(c);
+    resetStats();
+    yield();
+}
+
+void suite(void)
+{
+    sampleStats stats;
+    uint32_t t0, t1, i;
+
+    sched(true);
+    preempt(true);
+    tickless(false); // the cycle count is built from a fixed tick here
+    pi(true);
+
+    clearSamples(&stats);
+    for (i = 0; i < SAMPLES; i++)
+    {
+        t0 = cycles();
+        t1 = cycles();
+        addSample(&stats, t1 - t0);
+    }
+    reportSamples("timer_overhead", &stats);
+
+    runPhase(switchA, switchB, 0);
+
+    runPhase(sleeper, spinner, 0);
+    readWakeLatency("Sleeper", &stats);
+    reportSamples("preemption_time", &stats);
+
+    // Includes the return from the cycles svc that took the stamp, which is
+    // only half of timer_overhead, so nothing is taken off
+    clearSamples(&stats);
+    for (i = 0; i < SAMPLES; i++) addSample(&stats, triggerInterrupt(cycles(), LATENCY_IRQ));
+    reportSamples("interrupt_latency", &stats);
+
+    runPhase(waiter, 0, 0);
+    for (i = 0; i < SAMPLES; i++) triggerInterrupt(0, WAKE_IRQ);
+    readWakeLatency("Waiter", &stats);
+    reportSamples("interrupt_task_latency", &stats);
+    killThread(waiter);
+
+    runPhase(pinger, ponger, 0);
+
+    runPhase(high, mid, low);
+
+    // Each message is a heap block, whose ownership goes with it
+    runPhase(waiter, 0, 0);
+    for (i = 0; i < SAMPLES; i++)
+    {
+        sendQueue(wakeQueue, mallocHeap(BLOCK_SIZE), QUEUE_FOREVER);
+        yield();
+    }
+    readWakeLatency("Waiter", &stats);
+    reportSamples("message_latency", &stats);
+    killThread(waiter);
+
+    putsUart0("rhealstone done\n");
+    reboot();
+}
+
+//-----------------------------------------------------------------------------
+// Main
+//-----------------------------------------------------------------------------
+
+int main(void)
+{
+    bool ok;
+
+    initSystemClockTo40Mhz();
+    initUart0();
+    NVIC_SYS_HND_CTRL_R |= 0x00070000; //Enable all faults, bits 18 17 16
+
+    initMpu();
+    mpuEnable();
+
+    // Let tasks pend the suite interrupts through the software trigger register
+    NVIC_CFG_CTRL_R |= NVIC_CFG_CTRL_MAIN_PEND;
+    NVIC_PRI6_R &= ~NVIC_PRI6_INTB_M; // latencyIsr at priority 0
+    NVIC_PRI6_R = (NVIC_PRI6_R & ~NVIC_PRI6_INTC_M) | ((uint32_t)KERNEL_INT_PRIORITY << 21); // wakeIsr touches tcb
+    NVIC_EN0_R |= (1 << LATENCY_IRQ) | (1 << WAKE_IRQ);
+
+    initRtos();
+    initTimers();
+
+    initMutex(resource);
+    initSemaphore(pingSem, 0);
+    initSemaphore(pongSem, 0);
+    initQueue(wakeQueue, 1);
+
+    ok =  createThread(idle, "Idle", 7, 1024, 0);
+    ok &= createThread(suite, "Suite", 5, 3072, 0);
+    ok &= createThread(switchA, "SwitchA", 4, 1024, 0);
+    ok &= createThread(switchB, "SwitchB", 4, 1024, 0);
+    ok &= createThread(sleeper, "Sleeper", 3, 1024, 0);
+    ok &= createThread(spinner, "Spinner", 4, 1024, 0);
+    ok &= createThread(waiter, "Waiter", 3, 1024, 0);
+    ok &= createThread(pinger, "Pinger", 4, 1024, 0);
+    ok &= createThread(ponger, "Ponger", 4, 1024, 0);
+    ok &= createThread(high, "High", 1, 1024, 0);
+    ok &= createThread(mid, "Mid", 2, 1024, 0);
+    ok &= createThread(low, "Low", 3, 1024, 0);
+
+    if (!ok)
+    {
+        putsUart0("rhealstone error cannot create tasks\n");
+        while (true);
+    }
+
+    // Partners wait, killed, until the Suite restarts them for their phase
+    killThread_impl(switchA);
+    killThread_impl(switchB);
+    killThread_impl(sleeper);
+    killThread_impl(spinner);
+    killThread_impl(waiter);
+    killThread_impl(pinger);
+    killThread_impl(ponger);
+    killThread_impl(high);
+    killThread_impl(mid);
+    killThread_impl(low);
+
+    startRtos();
+
+    return 0;
+}
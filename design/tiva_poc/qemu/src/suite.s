@@ -0,0 +1,23 @@
+; Ahmed Abdulla
+; Copyright 2025 Ahmed Abdulla. All Rights Reserved.
+; (Excluding work produced by Professor Jason Losh)
+;
+; Rhealstone suite helpers
+; See qemu/src/rhealstone.c for the C prototypes
+
+    .thumb
+
+    .global triggerInterrupt
+
+; uint32_t triggerInterrupt(uint32_t stamp, uint32_t irq)
+; stamp = r0, irq = r1
+; Pends irq through the software trigger register (needs USERSETMPEND in
+; unprivileged mode). r0 is untouched until the interrupt is taken, so its
+; handler finds stamp in the stacked r0 and can replace it with a result.
+triggerInterrupt:
+    movw r2, #0xEF00 ; NVIC_SW_TRIG_R
+    movt r2, #0xE000
+    str r1, [r2]
+    dsb
+    isb
+    bx lr
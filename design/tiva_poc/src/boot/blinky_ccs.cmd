@@ -49,8 +49,11 @@ MEMORY
 {
     /* Application stored in and executes from internal flash */
     FLASH (RX) : origin = APP_BASE, length = 0x00040000
-    /* Application uses internal RAM for data */
-    SRAM (RWX) : origin = 0x20000000, length = 0x00008000
+    /* Kernel data, bss and the MSP stack. The heap starts right above at    */
+    /* HEAP_BASE (mm.h), so the link fails if the kernel outgrows this.      */
+    SRAM (RWX) : origin = 0x20000000, length = 0x00001000
+    /* Task stacks and allocations, handed out by mm.c                       */
+    HEAP (RW)  : origin = 0x20001000, length = 0x00007000
 }
 
 /* Section allocation in memory */
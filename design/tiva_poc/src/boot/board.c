@@ -0,0 +1,110 @@
+// Ahmed Abdulla
+// Copyright 2025 Ahmed Abdulla. All Rights Reserved.
+// (Excluding work produced by Professor Jason Losh)
+//
+// Board timers and UART pins
+// The cycle counter and accounting window timer behind clock.c, and UART0's
+// clocks and pins behind uart0.c. Ports to other boards (qemu/) supply their
+// own copy of this file.
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target uC:       TM4C123GH6PM
+// System Clock:    40 MHz
+
+//-----------------------------------------------------------------------------
+// Device includes, defines, and assembler directives
+//-----------------------------------------------------------------------------
+
+#include <stdint.h>
+#include "tm4c123gh6pm.h"
+#include "sys/clock.h"
+#include "sys/kernel.h"
+#include "io/uart0.h"
+
+// PortA masks
+#define UART_TX_MASK 2
+#define UART_RX_MASK 1
+
+// Core debug and DWT registers (not in tm4c123gh6pm.h)
+#define CORE_DEMCR_R           (*((volatile uint32_t *)0xE000EDFC))
+#define CORE_DEMCR_TRCENA      0x01000000
+#define DWT_CTRL_R             (*((volatile uint32_t *)0xE0001000))
+#define DWT_CTRL_CYCCNTENA     0x00000001
+#define DWT_CYCCNT_R           (*((volatile uint32_t *)0xE0001004))
+
+const uint32_t intervalALoad = 9999; //1 sec = 1 window = 10000 ticks of 100us
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+// DWT cycle counter
+void initCycleCounter(void)
+{
+    CORE_DEMCR_R |= CORE_DEMCR_TRCENA;
+    DWT_CYCCNT_R = 0;
+    DWT_CTRL_R |= DWT_CTRL_CYCCNTENA;
+}
+
+// Free running cpu cycle count, wraps every 107 seconds at 40MHz
+uint32_t getCycleCount(void)
+{
+    return DWT_CYCCNT_R;
+}
+
+// Wide Timer 0A, periodic every second, calls wTimer0AIsr
+void initWindowTimer(void)
+{
+    const uint32_t prescale = 3999; //Pre-divide to 10kHz
+
+    SYSCTL_RCGCWTIMER_R |= SYSCTL_RCGCWTIMER_R0;
+    NVIC_EN2_R |= 1 << 30; //Enable WTimer 0 A interrupt (interrupt 94)
+    //Touches tcb, so runs at kernel priority
+    NVIC_PRI23_R = (NVIC_PRI23_R & ~NVIC_PRI23_INTC_M) | (KERNEL_INT_PRIORITY << 21);
+
+    WTIMER0_CFG_R = 0x4;
+
+    //---- Wide Timer 0A setup ---- (interrupt generating)
+    WTIMER0_TAMR_R &= ~TIMER_TAMR_TAMR_M;
+    WTIMER0_TAMR_R |= 0x2; // periodic mode
+    WTIMER0_TAMR_R &= ~TIMER_TAMR_TACDIR; //count down
+    WTIMER0_TAILR_R = intervalALoad;
+    WTIMER0_IMR_R |= TIMER_IMR_TATOIM; // Interrupt on timer reaching intervalLoad
+
+    // stall timer when debugger is halted
+    WTIMER0_CTL_R |= TIMER_CTL_TASTALL;
+
+    // set prescale
+    WTIMER0_TAPR_R &= ~(TIMER_TAPR_TAPSR_M | TIMER_TAPR_TAPSRH_M);
+    WTIMER0_TAPR_R |= prescale;
+
+    //Enable
+    WTIMER0_CTL_R |= TIMER_CTL_TAEN;
+}
+
+void clearWindowTimer(void)
+{
+    WTIMER0_ICR_R |= TIMER_ICR_TATOCINT;
+}
+
+// UART0 on PA0 (U0RX) and PA1 (U0TX), clocked from the system clock
+void initUart0Board(void)
+{
+    // Enable clocks
+    SYSCTL_RCGCUART_R |= SYSCTL_RCGCUART_R0;
+    SYSCTL_RCGCGPIO_R |= SYSCTL_RCGCGPIO_R0;
+    _delay_cycles(3);
+
+    // Configure UART0 pins
+    GPIO_PORTA_DR2R_R |= UART_TX_MASK; // 2mA drive (the default, for clarity)
+    GPIO_PORTA_DEN_R |= UART_TX_MASK | UART_RX_MASK; // enable digital on UART0 pins
+    GPIO_PORTA_AFSEL_R |= UART_TX_MASK | UART_RX_MASK; // use peripheral to drive PA0, PA1
+    GPIO_PORTA_PCTL_R &= ~(GPIO_PCTL_PA1_M | GPIO_PCTL_PA0_M); // clear bits 0-7
+    GPIO_PORTA_PCTL_R |= GPIO_PCTL_PA1_U0TX | GPIO_PCTL_PA0_U0RX;
+
+    // UART0 is still disabled out of reset, so its clock source can change
+    UART0_CC_R = UART_CC_CS_SYSCLK;
+}
@@ -27,11 +27,529 @@
 #include "util/str.h"
 
 #include "sys/svc.h"
+#include "sys/clock.h"
+#include "sys/mm.h"
 
 //-----------------------------------------------------------------------------
 // Subroutines
 //-----------------------------------------------------------------------------
 
+// Prints cycles as an exact percentage of the window, to two decimal places
+void putCpuTime(uint32_t cycles, uint32_t window, uint8_t fieldSize)
+{
+    // hundredths of a percent
+    const uint32_t percent = window ? ((uint64_t)cycles * 10000) / window : 0;
+    const uint32_t fraction = percent % 100;
+
+    char str[16] = "";
+    uint32_t length;
+
+    _itoa(percent / 100, str);
+    length = _strlen(str);
+
+    str[length++] = '.';
+    str[length++] = '0' + fraction / 10;
+    str[length++] = '0' + fraction % 10;
+    str[length] = '\0';
+
+    putFieldUart0(str, fieldSize);
+}
+
+// Prints wake to run latency in microseconds, or "-" before the first sample
+void putLatency(uint32_t cycles, uint32_t samples, uint8_t fieldSize)
+{
+    if (samples) putIntFieldUart0(cycles / CYCLES_PER_US, fieldSize);
+    else putFieldUart0("-", fieldSize);
+}
+
+// Returns the smallest stack that holds peak bytes plus a quarter for
+// headroom (allocations are powers of 2 heap blocks, guard included)
+uint32_t getStackFit(uint32_t peak)
+{
+    uint32_t size = BLOCK_SIZE;
+
+    peak += peak/4;
+    while (size - STACK_GUARD_SIZE < peak) size <<= 1;
+
+    return size - STACK_GUARD_SIZE;
+}
+
+// Formats a ps snapshot, running at the shell's priority rather than in the kernel
+void printPs(void)
+{
+    psData *snapshot;
+    psTask *task;
+    int i;
+    const int fieldSize = 18;
+    const int statSize = 10;
+
+    // Too big for the shell's stack, so it lives on the heap while it is printed
+    snapshot = mallocHeap(sizeof(psData));
+    if (!snapshot)
+    {
+        putsUart0("ps: out of memory\n");
+        return;
+    }
+
+    ps(snapshot);
+
+    // Field names
+    putFieldUart0("pid", fieldSize);
+    putFieldUart0("name", fieldSize);
+    putFieldUart0("state", fieldSize);
+    putFieldUart0("sleep time", fieldSize);
+    putFieldUart0("blocked on", fieldSize);
+    putFieldUart0("%CPU 1s", statSize);
+    putFieldUart0("10s", statSize);
+    putFieldUart0("60s", statSize);
+    putFieldUart0("switches", statSize);
+    putFieldUart0("svcs", statSize);
+    putFieldUart0("lat min", statSize);
+    putFieldUart0("lat avg", statSize);
+    putFieldUart0("lat max (us)", statSize);
+    putFieldUart0("stack", statSize);
+    putFieldUart0("peak", statSize);
+    putFieldUart0("fits in", statSize);
+    putsUart0("\n");
+
+    for (i = 0; i < snapshot->taskCount; i++)
+    {
+        task = &snapshot->tasks[i];
+
+        putIntFieldUart0((uint32_t) task->pid, fieldSize);
+        putFieldUart0(task->name, fieldSize);
+
+        // Display state as string
+        switch(task->state)
+        {
+            case STATE_INVALID:           putFieldUart0("INVALID", fieldSize); break;
+            case STATE_UNRUN:             putFieldUart0("UNRUN", fieldSize); break;
+            case STATE_READY:             putFieldUart0("READY", fieldSize); break;
+            case STATE_DELAYED:           putFieldUart0("DELAYED", fieldSize); break;
+            case STATE_BLOCKED_SEMAPHORE: putFieldUart0("BLOCKED_SEMAPHORE", fieldSize); break;
+            case STATE_BLOCKED_MUTEX:     putFieldUart0("BLOCKED_MUTEX", fieldSize); break;
+            case STATE_KILLED:            putFieldUart0("KILLED", fieldSize); break;
+            case STATE_BLOCKED_EVENT:     putFieldUart0("BLOCKED_EVENT", fieldSize); break;
+            case STATE_BLOCKED_QUEUE:     putFieldUart0("BLOCKED_QUEUE", fieldSize); break;
+            default:                      putFieldUart0("", fieldSize); break;
+        }
+
+        if (task->state == STATE_DELAYED) putIntFieldUart0(task->sleepTicks, fieldSize);
+        else putFieldUart0("", fieldSize);
+
+        // Display blocking resource
+        if (task->state == STATE_BLOCKED_MUTEX)
+        {
+            char temp[9] = "mutex[";
+            temp[6] = _itoc(task->mutex);
+            temp[7] = ']';
+
+            putFieldUart0(temp, fieldSize);
+        }
+        else if (task->state == STATE_BLOCKED_SEMAPHORE)
+        {
+            char temp[13] = "semaphore[";
+            temp[10] = _itoc(task->semaphore);
+            temp[11] = ']';
+
+            putFieldUart0(temp, fieldSize);
+        }
+        else if (task->state == STATE_BLOCKED_EVENT)
+        {
+            char temp[9] = "event[";
+            temp[6] = _itoc(task->eventGroup);
+            temp[7] = ']';
+
+            putFieldUart0(temp, fieldSize);
+        }
+        else if (task->state == STATE_BLOCKED_QUEUE)
+        {
+            char temp[9] = "queue[";
+            temp[6] = _itoc(task->queue);
+            temp[7] = ']';
+
+            putFieldUart0(temp, fieldSize);
+        }
+        else putFieldUart0("", fieldSize);
+
+        // Display CPU time, the last window then the decayed averages
+        putCpuTime(task->cpuTime, snapshot->windowCycles, statSize);
+        putCpuTime(task->cpuLoad[1], CPU_LOAD_ONE, statSize);
+        putCpuTime(task->cpuLoad[2], CPU_LOAD_ONE, statSize);
+
+        // Display scheduling counters
+        putIntFieldUart0(task->switches, statSize);
+        putIntFieldUart0(task->svcCalls, statSize);
+        putLatency(task->latencyMin, task->latencySamples, statSize);
+        putLatency(task->latencySamples ? task->latencySum / task->latencySamples : 0, task->latencySamples, statSize);
+        putLatency(task->latencyMax, task->latencySamples, statSize);
+
+        // Stack usage, and the smallest stack the peak would fit in
+        putIntFieldUart0(task->stackSize, statSize);
+        putIntFieldUart0(task->stackPeak, statSize);
+        putIntFieldUart0(getStackFit(task->stackPeak), statSize);
+
+        putsUart0("\n");
+    }
+
+    // Kernel time is measured in the svc calls, isrs and pendsv
+    putFieldUart0("", fieldSize);
+    putFieldUart0("kernel", fieldSize);
+    putFieldUart0("", 3*fieldSize);
+
+    putCpuTime(snapshot->kernelCpuTime, snapshot->windowCycles, statSize);
+    putCpuTime(snapshot->kernelCpuLoad[1], CPU_LOAD_ONE, statSize);
+    putCpuTime(snapshot->kernelCpuLoad[2], CPU_LOAD_ONE, statSize);
+
+    // MSP stack, sized by the linker rather than the heap
+    putFieldUart0("", 5*statSize);
+    putIntFieldUart0(snapshot->kernelStackSize, statSize);
+    putIntFieldUart0(snapshot->kernelStackPeak, statSize);
+
+    putsUart0("\n");
+
+    // Heap summary
+    putsUart0("heap: ");
+    putIntUart0(snapshot->heapFree);
+    putsUart0(" bytes free, largest block ");
+    putIntUart0(snapshot->heapLargest);
+    putsUart0(", fragmentation ");
+    putIntUart0(snapshot->heapFragmentation);
+    putsUart0("%\n\n");
+
+    // Heap use per task, in blocks
+    putFieldUart0("name", fieldSize);
+    putFieldUart0("heap", statSize);
+    putFieldUart0("peak", statSize);
+    putFieldUart0("quota", statSize);
+    putFieldUart0("allocs", statSize);
+    putFieldUart0("frees", statSize);
+    putFieldUart0("failures", statSize);
+    putsUart0("\n");
+
+    for (i = 0; i < snapshot->taskCount; i++)
+    {
+        task = &snapshot->tasks[i];
+
+        putFieldUart0(task->name, fieldSize);
+        putIntFieldUart0(task->heapBlocks, statSize);
+        putIntFieldUart0(task->heapPeak, statSize);
+        if (task->heapQuota) putIntFieldUart0(task->heapQuota, statSize);
+        else putFieldUart0("-", statSize);
+        putIntFieldUart0(task->allocs, statSize);
+        putIntFieldUart0(task->frees, statSize);
+        putIntFieldUart0(task->allocFailures, statSize);
+        putsUart0("\n");
+    }
+
+    freeHeap(snapshot, sizeof(psData));
+}
+
+// Prints the task's accessible SRAM as address ranges, one per run of
+// enabled subregions
+void putSramWindows(uint32_t srd)
+{
+    bool first = true;
+    int start, end = 0;
+
+    while (end < 32)
+    {
+        // Next enabled (clear) bit, then the end of its run
+        start = end;
+        while (start < 32 && (srd >> start) & 1) start++;
+        end = start;
+        while (end < 32 && !((srd >> end) & 1)) end++;
+
+        if (start == end) break;
+
+        if (!first) putsUart0(", ");
+        putHexUart0(SRAM_BASE + start*BLOCK_SIZE);
+        putcUart0('-');
+        putHexUart0(SRAM_BASE + end*BLOCK_SIZE - 1);
+        first = false;
+    }
+
+    if (first) putsUart0("none");
+}
+
+// Formats a meminfo snapshot, running at the shell's priority rather than in the kernel
+void printMemInfo(void)
+{
+    memInfoData *snapshot;
+    memAllocation *allocation;
+    int i, j;
+    const int fieldSize = 16;
+
+    // Too big for the shell's stack, so it lives on the heap while it is printed
+    snapshot = mallocHeap(sizeof(memInfoData));
+    if (!snapshot)
+    {
+        putsUart0("meminfo: out of memory\n");
+        return;
+    }
+
+    memInfo(snapshot);
+
+    // Allocations
+    putsUart0("------ Heap ------\n");
+    putFieldUart0("address", fieldSize);
+    putFieldUart0("bytes", fieldSize);
+    putFieldUart0("owner", fieldSize);
+    putFieldUart0("shared with", fieldSize);
+    putsUart0("\n");
+
+    for (i = 0; i < snapshot->allocationCount; i++)
+    {
+        allocation = &snapshot->allocations[i];
+
+        putHexFieldUart0(allocation->address, fieldSize);
+        putIntFieldUart0(allocation->size, fieldSize);
+
+        if (allocation->owner == NO_TASK) putFieldUart0("kernel", fieldSize);
+        else putFieldUart0(snapshot->taskNames[allocation->owner], fieldSize);
+
+        // Sharers, (ro) for read-only
+        for (j = 0; j < MAX_TASKS; j++)
+        {
+            if (!((allocation->sharers >> j) & 1)) continue;
+
+            putsUart0(snapshot->taskNames[j]);
+            if (!((allocation->writers >> j) & 1)) putsUart0("(ro)");
+            putcUart0(' ');
+        }
+
+        putsUart0("\n");
+    }
+
+    putsUart0("free ");
+    putIntUart0(snapshot->heapFree);
+    putsUart0(" bytes, largest block ");
+    putIntUart0(snapshot->heapLargest);
+    putsUart0(", fragmentation ");
+    putIntUart0(snapshot->heapFragmentation);
+    putsUart0("%\n");
+
+    putsUart0("realloc: ");
+    putIntUart0(snapshot->realloc.inPlace);
+    putsUart0(" in place, ");
+    putIntUart0(snapshot->realloc.moved);
+    putsUart0(" moved, ");
+    putIntUart0(snapshot->realloc.failed);
+    putsUart0(" failed\n\n");
+
+    // MPU windows per task
+    putsUart0("------ MPU ------\n");
+    putFieldUart0("task", fieldSize);
+    putFieldUart0("srd", fieldSize);
+    putFieldUart0("read-write", fieldSize);
+    putsUart0("\n");
+
+    for (i = 0; i < MAX_TASKS; i++)
+    {
+        if (!snapshot->taskNames[i][0]) continue;
+
+        putFieldUart0(snapshot->taskNames[i], fieldSize);
+        putHexFieldUart0(snapshot->srd[i], fieldSize);
+        putSramWindows(snapshot->srd[i]);
+
+        if (snapshot->roSize[i])
+        {
+            putsUart0(", read-only ");
+            putHexUart0(snapshot->roBase[i]);
+            putcUart0('-');
+            putHexUart0(snapshot->roBase[i] + snapshot->roSize[i] - 1);
+        }
+
+        putsUart0("\n");
+    }
+
+    freeHeap(snapshot, sizeof(memInfoData));
+}
+
+void putWaitQueue(const ipcsData *snapshot, const uint8_t *queue, uint8_t queueSize)
+{
+    int i;
+    for (i = 0; i < queueSize; i++)
+    {
+        if (i > 0) putsUart0(", ");
+        putsUart0((char *)snapshot->taskNames[queue[i]]);
+    }
+}
+
+// Formats an ipcs snapshot, running at the shell's priority rather than in the kernel
+void printIpcs(void)
+{
+    ipcsData *snapshot;
+    int i, j;
+    bool first;
+    const int fieldSize = 16;
+
+    // Too big for the shell's stack, so it lives on the heap while it is printed
+    snapshot = mallocHeap(sizeof(ipcsData));
+    if (!snapshot)
+    {
+        putsUart0("ipcs: out of memory\n");
+        return;
+    }
+
+    ipcs(snapshot);
+
+    // Field names
+    putsUart0("------ Mutexes ------\n");
+    putFieldUart0("index", fieldSize);
+    putFieldUart0("locked", fieldSize);
+    putFieldUart0("held by", fieldSize);
+    putFieldUart0("queue size", fieldSize);
+    putFieldUart0("waiting", fieldSize);
+    putsUart0("\n");
+
+    // Field values
+    for (i = 0; i < MAX_MUTEXES; i++)
+    {
+        // Index
+        putIntFieldUart0(i, fieldSize);
+
+        // Whether locked or not
+        putFieldUart0(snapshot->mutexes[i].lock ? "true" : "false", fieldSize);
+
+        // Who's locking this mutex
+        if (snapshot->mutexes[i].lockedBy < MAX_TASKS)
+        {
+            putFieldUart0(snapshot->taskNames[snapshot->mutexes[i].lockedBy], fieldSize);
+        }
+        else
+        {
+            putFieldUart0("N/A", fieldSize);
+        }
+
+        // Queue size
+        putIntFieldUart0(snapshot->mutexes[i].queueSize, fieldSize);
+
+        // Tasks in queue
+        putWaitQueue(snapshot, snapshot->mutexes[i].processQueue, snapshot->mutexes[i].queueSize);
+
+        putsUart0("\n");
+    }
+
+    // Separator
+    putsUart0("\n");
+
+    // Semaphores
+    putsUart0("------ Semaphores ------\n");
+    putFieldUart0("index", fieldSize);
+    putFieldUart0("count", fieldSize);
+    putFieldUart0("queue size", fieldSize);
+    putFieldUart0("waiting", fieldSize);
+    putsUart0("\n");
+
+    // Field values
+    for (i = 0; i < MAX_SEMAPHORES; i++)
+    {
+        // Index
+        putIntFieldUart0(i, fieldSize);
+
+        // Sema count
+        putIntFieldUart0(snapshot->semaphores[i].count, fieldSize);
+
+        // Queue size
+        putIntFieldUart0(snapshot->semaphores[i].queueSize, fieldSize);
+
+        // Tasks in queue
+        putWaitQueue(snapshot, snapshot->semaphores[i].processQueue, snapshot->semaphores[i].queueSize);
+
+        putsUart0("\n");
+    }
+
+    // Separator
+    putsUart0("\n");
+
+    // Event groups
+    putsUart0("------ Event groups ------\n");
+    putFieldUart0("index", fieldSize);
+    putFieldUart0("flags", fieldSize);
+    putFieldUart0("waiting (mask)", fieldSize);
+    putsUart0("\n");
+
+    for (i = 0; i < MAX_EVENT_GROUPS; i++)
+    {
+        putIntFieldUart0(i, fieldSize);
+        putHexFieldUart0(snapshot->eventGroups[i].flags, fieldSize);
+
+        // Waiters, from the task bits
+        first = true;
+        for (j = 0; j < MAX_TASKS; j++)
+        {
+            if (!(snapshot->eventGroups[i].waiters & (1 << j))) continue;
+
+            if (!first) putsUart0(", ");
+            putsUart0(snapshot->taskNames[j]);
+            putsUart0(" (");
+            putHexUart0(snapshot->eventMasks[j]);
+            putsUart0(")");
+            first = false;
+        }
+
+        putsUart0("\n");
+    }
+
+    // Separator
+    putsUart0("\n");
+
+    // Message queues
+    putsUart0("------ Queues ------\n");
+    putFieldUart0("index", fieldSize);
+    putFieldUart0("queued", fieldSize);
+    putFieldUart0("depth", fieldSize);
+    putFieldUart0("high water", fieldSize);
+    putFieldUart0("waiting", fieldSize);
+    putsUart0("\n");
+
+    for (i = 0; i < MAX_QUEUES; i++)
+    {
+        if (snapshot->queues[i].depth == 0) continue;
+
+        putIntFieldUart0(i, fieldSize);
+        putIntFieldUart0(snapshot->queues[i].count, fieldSize);
+        putIntFieldUart0(snapshot->queues[i].depth, fieldSize);
+        putIntFieldUart0(snapshot->queues[i].highWater, fieldSize);
+
+        // Blocked senders and receivers, from the task bits
+        first = true;
+        for (j = 0; j < MAX_TASKS; j++)
+        {
+            if (!((snapshot->queues[i].senders | snapshot->queues[i].receivers) & (1 << j))) continue;
+
+            if (!first) putsUart0(", ");
+            putsUart0(snapshot->taskNames[j]);
+            putsUart0((snapshot->queues[i].senders & (1 << j)) ? " (send)" : " (receive)");
+            first = false;
+        }
+
+        putsUart0("\n");
+    }
+
+    // Separator
+    putsUart0("\n");
+
+    // UART0 buffers
+    putsUart0("------ UART0 ------\n");
+    putFieldUart0("tx high water", fieldSize);
+    putFieldUart0("tx dropped", fieldSize);
+    putFieldUart0("rx high water", fieldSize);
+    putFieldUart0("rx dropped", fieldSize);
+    putFieldUart0("rx errors", fieldSize);
+    putsUart0("\n");
+
+    putIntFieldUart0(snapshot->uart.txHighWater, fieldSize);
+    putIntFieldUart0(snapshot->uart.txDropped, fieldSize);
+    putIntFieldUart0(snapshot->uart.rxHighWater, fieldSize);
+    putIntFieldUart0(snapshot->uart.rxDropped, fieldSize);
+    putIntFieldUart0(snapshot->uart.rxErrors, fieldSize);
+    putsUart0("\n");
+
+    freeHeap(snapshot, sizeof(ipcsData));
+}
+
 
 void shell(void)
 {
@@ -50,18 +568,23 @@ void shell(void)
         //ps
         else if (isCommand(&data, "ps", 0))
         {
-            ps();
+            printPs();
         }
         //ipcs
         else if (isCommand(&data, "ipcs", 0))
         {
-            ipcs();
+            printIpcs();
         }
         //kill <pid>
         else if (isCommand(&data, "kill", 1))
         {
             kill( (_fn) getFieldInteger(&data, 1));
         }
+        //quota <pid> <blocks>
+        else if (isCommand(&data, "quota", 2))
+        {
+            setHeapQuota( (_fn) getFieldInteger(&data, 1), getFieldInteger(&data, 2));
+        }
         //pkill <proc_name>
         else if (isCommand(&data, "pkill", 1))
         {
@@ -88,6 +611,22 @@ void shell(void)
             if (!_strcmp(getFieldString(&data, 1), "prio")) sched(true);
             else if (!_strcmp(getFieldString(&data, 1), "rr")) sched(false);
         }
+        //tickless <on|off>
+        else if (isCommand(&data, "tickless", 1))
+        {
+            if (!_strcmp(getFieldString(&data, 1), "on")) tickless(true);
+            else if (!_strcmp(getFieldString(&data, 1), "off")) tickless(false);
+        }
+        //meminfo
+        else if (isCommand(&data, "meminfo", 0))
+        {
+            printMemInfo();
+        }
+        //resetstats
+        else if (isCommand(&data, "resetstats", 0))
+        {
+            resetStats();
+        }
         //pidof <proc_name>
         else if (isCommand(&data, "pidof", 1))
         {
@@ -32,15 +32,45 @@
 #include "sys/kernel.h"
 #include "util/str.h"
 #include "sys/svc.h"
+#include "sys/asm.h"
+#include "sys/clock.h"
 
-// PortA masks
-#define UART_TX_MASK 2
-#define UART_RX_MASK 1
+// Ring sizes (power of 2, one slot is always left empty)
+#define TX_RING_SIZE 256
+#define RX_RING_SIZE 64
+
+// Writers blocked on a full tx ring are woken once this much is free
+#define TX_WAKE_FREE (TX_RING_SIZE/2)
+
+// IPSR exception numbers of NMI and the fault handlers
+#define FIRST_FAULT_EXCEPTION 2
+#define LAST_FAULT_EXCEPTION 6
+
+#define txCount() ((uint16_t)(txHead - txTail) & (TX_RING_SIZE-1))
 
 //-----------------------------------------------------------------------------
 // Global variables
 //-----------------------------------------------------------------------------
 
+// Buffers are kernel memory, only touched at KERNEL_INT_PRIORITY (svc calls and
+// uart0Isr), so the isr and the svc handlers never interrupt each other.
+char txRing[TX_RING_SIZE];
+uint16_t txHead = 0; // next byte written
+uint16_t txTail = 0; // next byte sent
+
+// Bytes received but not yet edited into the line, so type-ahead and pasted
+// input wait here while a finished line is unread
+char rxRing[RX_RING_SIZE];
+uint8_t rxHead = 0; // next byte received
+uint8_t rxTail = 0; // next byte edited into rxLine
+
+// Line being typed, edited in place from the rx ring
+char rxLine[MAX_CHARS+1];
+uint8_t rxLength = 0;
+bool rxLineReady = false; // rxLine holds a finished line nobody has read yet
+
+uartStats uart0Stats = {0};
+
 //-----------------------------------------------------------------------------
 // Subroutines
 //-----------------------------------------------------------------------------
@@ -111,61 +141,35 @@ void putFieldUart0(char *str, uint8_t fieldSize)
 }
 
 
+// Blocks until uart0isr has assembled a full line, then copies it into data
 void getsUart0(USER_DATA *data)
 {
-    int count = 0;
+    // Woken by uartRxLine; another reader may have taken the line first
+    int32_t result;
 
-    char temp;
-
-    while (1) 
-    {
-        temp = getcUart0();
-
-        if ((temp == 8 || temp == 127) && count > 0) count--; /* Backspace */ 
-        else if (temp == 13) 
-        { //Carriage return
-            data->buffer[count] = '\0';
-            return;
-        }
-        else if (temp >= 32) 
-        { //Printable characters
-            data->buffer[count] = temp;
-            count++;
-
-            if (count == MAX_CHARS) 
-            { //No more space
-                data->buffer[count] = '\0';
-                return;
-            }
-        }
-    }
+    while ((result = readLine(data->buffer, MAX_CHARS+1)) == 0);
 
+    // Buffer rejected by the kernel
+    if (result < 0) data->buffer[0] = '\0';
 }
 
 // Initialize UART0
 void initUart0() {
-  // Enable clocks
-  SYSCTL_RCGCUART_R |= SYSCTL_RCGCUART_R0;
-  SYSCTL_RCGCGPIO_R |= SYSCTL_RCGCGPIO_R0;
-  _delay_cycles(3);
-
-  // Configure UART0 pins
-  GPIO_PORTA_DR2R_R |= UART_TX_MASK; // set drive strength to 2mA (not needed since default
-                    // configuration -- for clarity)
-  GPIO_PORTA_DEN_R |= UART_TX_MASK | UART_RX_MASK; // enable digital on UART0 pins
-  GPIO_PORTA_AFSEL_R |= UART_TX_MASK | UART_RX_MASK; // use peripheral to drive PA0, PA1
-  GPIO_PORTA_PCTL_R &= ~(GPIO_PCTL_PA1_M | GPIO_PCTL_PA0_M); // clear bits 0-7
-  GPIO_PORTA_PCTL_R |= GPIO_PCTL_PA1_U0TX | GPIO_PCTL_PA0_U0RX;
-  // select UART0 to drive pins PA0 and PA1: default, added for clarity
-
-  // Configure UART0 to 115200 baud, 8N1 format
+  // Clocks, pins and clock source are the board's (src/boot/board.c)
+  initUart0Board();
+
+  // Configure UART0 to 115200 baud, 8N1 format, from the 40 MHz system clock
   UART0_CTL_R = 0;                // turn-off UART0 to allow safe programming
-  UART0_CC_R = UART_CC_CS_SYSCLK; // use system clock (40 MHz)
   UART0_IBRD_R = 21; // r = 40 MHz / (Nx115.2kHz), set floor(r)=21, where N=16
   UART0_FBRD_R = 45; // round(fract(r)*64)=45
   UART0_LCRH_R = UART_LCRH_WLEN_8 | UART_LCRH_FEN; // configure for 8N1 w/ 16-level FIFO
   UART0_CTL_R = UART_CTL_TXE | UART_CTL_RXE | UART_CTL_UARTEN;
   // enable TX, RX, and module
+
+  // Interrupt on rx fifo level and rx timeout; tx is enabled while bytes are queued
+  UART0_IM_R = UART_IM_RXIM | UART_IM_RTIM;
+  NVIC_PRI1_R = (NVIC_PRI1_R & ~NVIC_PRI1_INTB_M) | (KERNEL_INT_PRIORITY << 13);
+  NVIC_EN0_R |= 1 << 5; //Enable UART0 interrupt (interrupt 5)
 }
 
 // Set baud rate as function of instruction cycle frequency
@@ -181,33 +185,197 @@ void setUart0BaudRate(uint32_t baudRate, uint32_t fcyc) {
   // turn-on UART0
 }
 
-// Blocking function that writes a serial character when the UART buffer is not
-// full
-void putcUart0(char c) {
+// Moves queued bytes into the tx fifo, keeping the tx interrupt on while any remain
+void fillTxFifo(void)
+{
+  while (txTail != txHead && !(UART0_FR_R & UART_FR_TXFF))
+  {
+    UART0_DR_R = txRing[txTail];
+    txTail = (txTail + 1) & (TX_RING_SIZE-1);
+  }
+
+  if (txTail != txHead) UART0_IM_R |= UART_IM_TXIM;
+  else UART0_IM_R &= ~UART_IM_TXIM;
+}
+
+// Queues as much of str as fits in the tx ring and returns the number of bytes taken
+// Kernel side only: must run at KERNEL_INT_PRIORITY
+uint32_t writeUart0(const char *str, uint32_t size)
+{
+  uint32_t count = 0;
+  uint16_t next;
+
+  while (count < size)
+  {
+    next = (txHead + 1) & (TX_RING_SIZE-1);
+    if (next == txTail) break; // ring full
+
+    txRing[txHead] = str[count++];
+    txHead = next;
+  }
+
+  if (txCount() > uart0Stats.txHighWater) uart0Stats.txHighWater = txCount();
+
+  fillTxFifo();
+
+  return count;
+}
+
+// Edits bytes from the rx ring into the rx line until a line is finished,
+// then wakes the readers waiting for it
+// Kernel side only: must run at KERNEL_INT_PRIORITY
+void assembleRxLine(void)
+{
+  char c;
+
+  // Line editing: backspace, carriage return and printable characters
+  while (!rxLineReady && rxTail != rxHead)
+  {
+    c = rxRing[rxTail];
+    rxTail = (rxTail + 1) & (RX_RING_SIZE-1);
+
+    if ((c == 8 || c == 127) && rxLength > 0) rxLength--; /* Backspace */
+    else if (c == 13)
+    { //Carriage return
+      rxLine[rxLength] = '\0';
+      rxLineReady = true;
+    }
+    else if (c >= 32)
+    { //Printable characters
+      rxLine[rxLength++] = c;
+
+      if (rxLength > uart0Stats.rxHighWater) uart0Stats.rxHighWater = rxLength;
+
+      if (rxLength == MAX_CHARS)
+      { //No more space
+        rxLine[rxLength] = '\0';
+        rxLineReady = true;
+      }
+    }
+  }
+
+  // Wake readers only when there is a whole line for them
+  if (rxLineReady && semaphores[uartRxLine].queueSize > 0)
+  {
+    while (semaphores[uartRxLine].queueSize > 0) post_impl(uartRxLine);
+    triggerPendSv();
+  }
+}
+
+// Copies a finished line into str (at most size bytes, always terminated)
+// Returns false if no line is ready yet. The next line is then assembled from
+// anything already received.
+// Kernel side only: must run at KERNEL_INT_PRIORITY
+bool readUart0Line(char *str, uint32_t size)
+{
+  uint32_t i;
+
+  if (!rxLineReady || size == 0) return false;
+
+  for (i = 0; i < size-1 && rxLine[i] != '\0'; i++) str[i] = rxLine[i];
+  str[i] = '\0';
+
+  rxLength = 0;
+  rxLineReady = false;
+
+  assembleRxLine();
+
+  return true;
+}
+
+// Polled write for faults and code running before the rtos starts
+// Sends anything still queued first so output stays in order
+void putcPolledUart0(char c)
+{
+  UART0_IM_R &= ~UART_IM_TXIM;
+
+  while (txTail != txHead)
+  {
+    while (UART0_FR_R & UART_FR_TXFF);
+    UART0_DR_R = txRing[txTail];
+    txTail = (txTail + 1) & (TX_RING_SIZE-1);
+  }
+
   while (UART0_FR_R & UART_FR_TXFF);             // wait if uart0 tx fifo full
   UART0_DR_R = c; // write character to fifo
 }
 
-// Blocking function that writes a string when the UART buffer is not full
+// Writes size bytes, picking the path that suits the caller:
+//   fault handlers and privileged thread mode poll the fifo directly,
+//   kernel handlers queue what fits and count the rest as dropped,
+//   tasks queue through the write svc and block while the ring is full.
+void putUart0(const char *str, uint32_t size)
+{
+  const uint32_t exception = getIpsr() & 0x1FF;
+  int32_t count;
+
+  if ((exception == 0 && !(getControl() & 1))
+      || (exception >= FIRST_FAULT_EXCEPTION && exception <= LAST_FAULT_EXCEPTION))
+  {
+    while (size--) putcPolledUart0(*str++);
+  }
+  else if (exception != 0)
+  {
+    count = writeUart0(str, size);
+    uart0Stats.txDropped += size - count;
+  }
+  else
+  {
+    while (size > 0)
+    {
+      count = write((char *)str, size);
+      if (count < 0) return; // buffer rejected by the kernel
+      str += count;
+      size -= count;
+    }
+  }
+}
+
+// Writes a serial character, see putUart0 for when this blocks
+void putcUart0(char c) {
+  putUart0(&c, 1);
+}
+
+// Writes a string, see putUart0 for when this blocks
 void putsUart0(char *str) {
-  uint8_t i = 0;
-  while (str[i] != '\0') putcUart0(str[i++]);
+  putUart0(str, _strlen(str));
 }
 
-// Blocking function that returns with serial data once the buffer is not empty
-char getcUart0(int *status) {
-  uartData uart0 = {0};
-  readUart(&uart0);
+// Queues received bytes, assembles them into the rx line and refills the tx fifo
+void uart0Isr(void)
+{
+  uint32_t data;
+  uint8_t next;
+
+  enterKernelTime();
 
-  if (uart0.isRxFull) *status = uart0.error;
+  UART0_ICR_R = UART0_MIS_R; // clear before draining so nothing new is missed
 
-  while (uart0.isRxEmpty) { // wait if uart0 rx fifo empty
-    yield();
-    readUart(&uart0);
+  // Empty the fifo into the rx ring, even while a finished line is unread
+  while (!(UART0_FR_R & UART_FR_RXFE))
+  {
+    data = UART0_DR_R;
+    next = (rxHead + 1) & (RX_RING_SIZE-1);
+
+    if (data & 0xF00) uart0Stats.rxErrors++; // OE, BE, PE, FE
+    else if (next == rxTail) uart0Stats.rxDropped++; // ring full
+    else
+    {
+      rxRing[rxHead] = data & 0xFF;
+      rxHead = next;
+    }
   }
 
-  return uart0.value; // get character from fifo
-}
+  assembleRxLine();
 
-// Returns the status of the receive buffer
-bool kbhitUart0() { return !(UART0_FR_R & UART_FR_RXFE); }
+  fillTxFifo();
+
+  // Wake blocked writers once there is room worth retrying for
+  if (TX_RING_SIZE - txCount() > TX_WAKE_FREE && semaphores[uartTxSpace].queueSize > 0)
+  {
+    while (semaphores[uartTxSpace].queueSize > 0) post_impl(uartTxSpace);
+    triggerPendSv();
+  }
+
+  exitKernelTime();
+}
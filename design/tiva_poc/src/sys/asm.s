@@ -9,37 +9,40 @@
     .thumb
     ;.align 2
     .global setTmpl, setAsp, setPspAddress, setPsp, startRtosHelper
-    .global getSvcNum, getSvcParam, getSvcParam2
-    .global getPsp, getSp, getMsp
-    .global initUnrunTask, saveRegPendsv, restoreRegPendsv, dummyFn
-
-saveRegPendsv:
-    mrs r0, psp
+    .global svcResult
+    .global getPsp, getSp, getMsp, getIpsr, getControl, countLeadingZeros
+    .global raiseBasepri, restoreBasepri
+    .global pendSvIsr
+    .thumbfunc pendSvIsr
+    .ref selectNextTask, switchTask
+
+; PendSV handler, running at the lowest exception priority.
+; systick and the svc calls only pend it, so it tail-chains after them.
+; Kernel-priority interrupts are masked through basepri while the
+; scheduler runs; anything above kernel priority is never held off.
+pendSvIsr:
+    mov r0, #0xC0 ; KERNEL_INT_PRIORITY << 5
+    msr basepri, r0
+    push {r3, lr} ; keep lr (EXC_RETURN) and 8-byte stack alignment
+
+    bl selectNextTask
+    cbz r0, pendSvDone ; SWITCH_NONE: same task keeps running
+
+    ; Save outgoing context, unless the task was killed (SWITCH_DISCARD), as
+    ; its psp may be below its stack. Then switch, restore incoming context
+    cmp r0, #2 ; SWITCH_DISCARD
+    mrs r0, psp ; flags are kept
+    beq pendSvSwitch
     stmfd r0!, {r4-r11}
-    msr psp, r0
-    bx lr
-
-restoreRegPendsv:
-    mrs r0, psp
+pendSvSwitch:
+    bl switchTask ; r0 = outgoing sp, returns incoming sp
     ldmfd r0!, {r4-r11}
     msr psp, r0
-    bx lr
 
-; void initUnrunTask(void *fn);
-; fn = r0
-;
-initUnrunTask:
-    mrs r1, psp
-    
-    mov r2, #0x01000000
-
-    ; Create caller stack frame
-    stmfd r1!, {r2} ; Store xPSR
-    stmfd r1!, {r0} ; Store fn addr to PC
-    stmfd r1!, {r4-r9} ; Dummy values for the rest of caller stack frame
-
-    msr psp, r1
-    bx lr
+pendSvDone:
+    mov r0, #0
+    msr basepri, r0
+    pop {r3, pc} ; exception return
 
 ; Helper function to switch to unprivileged state and run task. Never returns
 ; void startRtosHelper(void * fn)
@@ -68,6 +71,39 @@ getMsp:
     mrs r0, msp
     bx lr
 
+; uint32_t getIpsr(void)
+; Active exception number, 0 in thread mode
+getIpsr:
+    mrs r0, ipsr
+    bx lr
+
+; uint32_t getControl(void)
+; Bit 0 (tmpl) set when thread mode is unprivileged
+getControl:
+    mrs r0, control
+    bx lr
+
+; uint32_t raiseBasepri(void)
+; Masks interrupts at kernel priority and below, returning the previous basepri.
+; basepri_max only ever raises the mask, so this nests inside pendsv.
+raiseBasepri:
+    mrs r0, basepri
+    mov r1, #0xC0 ; KERNEL_INT_PRIORITY << 5
+    msr basepri_max, r1
+    bx lr
+
+; void restoreBasepri(uint32_t basepri)
+; basepri = r0 (value from raiseBasepri)
+restoreBasepri:
+    msr basepri, r0
+    bx lr
+
+; uint32_t countLeadingZeros(uint32_t value)
+; value = r0
+countLeadingZeros:
+    clz r0, r0
+    bx lr
+
 ; void setPsp(void *ptr)
 ; ptr = r0
 setPsp:
@@ -100,25 +136,8 @@ setTmpl:
     msr control, r1
     bx lr
 
-; void *getSvcParam(void)
-; SVC parameter is stored in r0 in stack frame,
-; aka the first element in PSP
-getSvcParam:
-    mrs r1, psp
-    ldr r0, [r1]
-    bx lr
-
-; void *getSvcParamSize(void)
-; SVC parameter length is stored in r1 in stack frame,
-; aka the second element in PSP
-getSvcParam2:
-    mrs r1, psp
-    ldr r0, [r1, #4]
-    bx lr
-
-; uint8_t getSvcNum(void)
-getSvcNum:
-    mrs r1, psp
-    ldr r2, [r1, #24] ; Move up by 6 words (6*4 = 24 bytes) to get stacked PC addr
-    ldrb r0, [r2, #-2]  ; Load bottom byte of PC - 2 bytes (prev instruction) = svc #imm
+; uint32_t svcResult(void)
+; Called straight after an svc instruction. Exception return reloads r0
+; from the stacked frame, where the handler left its return value.
+svcResult:
     bx lr
@@ -28,16 +28,28 @@
 
 #define CLK_FREQ 40E6
 
-bool time_slot = 0;
 extern uint8_t taskCurrent;
 
-const uint32_t intervalALoad = 10240; //1 sec = 1 frame = 10000 ticks
-const uint32_t intervalBLoad = 0xFFFFFF; // just has to be larger than intervalA
-
 //-----------------------------------------------------------------------------
 // Global variables
 //-----------------------------------------------------------------------------
 
+uint32_t taskStartCycles = 0;   // cycle count when time was last charged to a task or the kernel
+uint32_t windowStartCycles = 0; // cycle count when the current window started
+
+// Cycles run so far in the current window, by task, then the kernel (CPU_KERNEL)
+uint32_t cpuCycles[MAX_TASKS + 1];
+
+// Published once a window, under cpuStatsSeq
+volatile uint32_t cpuStatsSeq = 0;               // odd while the window isr is updating
+uint32_t windowCycles = 0;                       // length of the last finished window
+uint32_t cpuTime[MAX_TASKS + 1];                 // cycles run in the last finished window
+uint32_t cpuLoad[MAX_TASKS + 1][CPU_LOAD_WINDOWS];
+
+// exp(-1/n) << CPU_LOAD_SHIFT, for averages over n = 1, 10 and 60 windows.
+// The 1 second average is the last window itself.
+const uint32_t cpuLoadDecay[CPU_LOAD_WINDOWS] = { 0, 59300, 64453 };
+
 //-----------------------------------------------------------------------------
 // Subroutines
 //-----------------------------------------------------------------------------
@@ -50,137 +62,140 @@ void initSystemClockTo40Mhz(void)
             | SYSCTL_RCC_USESYSDIV | (4 << SYSCTL_RCC_SYSDIV_S);
 }
 
+// The cycle counter and the window timer are board specific (src/boot/board.c)
 void initTimers()
 {
-    const uint32_t prescale = 3999; //Pre-divide by 2
-
-    // Setup GPTMs for tracking task execution time
-    // Wide Timer 0A triggers int every 1 second, Wide Timer 0B tracks time of current task
-    SYSCTL_RCGCWTIMER_R |= SYSCTL_RCGCWTIMER_R0;
-    NVIC_EN2_R |= 1 << 30; //Enable WTimer 0 A interrupt (interrupt 94)
-    //NVIC_EN2_R |= 1 << 31; //Enable WTimer 0 B interrupt (interrupt 95)
-
-    WTIMER0_CFG_R = 0x4;
-
-    //---- Wide Timer 0A setup ---- (interrupt generating)
-    WTIMER0_TAMR_R &= ~TIMER_TAMR_TAMR_M;
-    WTIMER0_TAMR_R |= 0x2; // periodic mode
-    WTIMER0_TAMR_R &= ~TIMER_TAMR_TACDIR; //count down
-    WTIMER0_TAILR_R = intervalALoad;
-    WTIMER0_IMR_R |= TIMER_IMR_TATOIM; // Interrupt on timer reaching intervalLoad
-
-    // stall timer when debugger is halted
-    WTIMER0_CTL_R |= TIMER_CTL_TASTALL;
-    WTIMER0_CTL_R |= TIMER_CTL_TBSTALL;
-
-    // set prescale
-    WTIMER0_TAPR_R &= ~(TIMER_TAPR_TAPSR_M | TIMER_TAPR_TAPSRH_M);
-    WTIMER0_TAPR_R |= prescale;
-
-
-
-    //---- Wide Timer 0B setup ---- (non-interrupt generating)
-    WTIMER0_TBMR_R &= ~TIMER_TBMR_TBMR_M;
-    WTIMER0_TBMR_R |= 0x2;
-    WTIMER0_TBILR_R = intervalBLoad; //effectively infinite
-    WTIMER0_TBMR_R &= ~TIMER_TBMR_TBCDIR;
-    // set prescale
-    WTIMER0_TBPR_R &= ~(TIMER_TBPR_TBPSR_M | TIMER_TBPR_TBPSRH_M);
-    WTIMER0_TBPR_R |= prescale;
-
-    //Enable
-    WTIMER0_CTL_R |= TIMER_CTL_TAEN;
+    // Task run time is counted in cpu cycles
+    initCycleCounter();
 
+    // Window timer interrupts every 1 second to close the accounting window
+    windowStartCycles = getCycleCount();
+    initWindowTimer();
 }
 
-void clearTimer()
+void startCurrentTaskDuration()
 {
-    WTIMER0_TBV_R = intervalBLoad;
+    taskStartCycles = getCycleCount();
 }
 
-void disableTimer()
+uint32_t getCurrentTaskDuration()
 {
-    WTIMER0_CTL_R &= ~TIMER_CTL_TBEN;
+    return getCycleCount() - taskStartCycles;
 }
 
-void enableTimer()
+// Charges the time since the last switch or kernel exit to the running task.
+// Called first by every kernel entry point (svc, isrs, pendsv). They all run
+// at KERNEL_INT_PRIORITY (pendsv raises basepri to it), so they never nest.
+void enterKernelTime(void)
 {
-    WTIMER0_CTL_R |= TIMER_CTL_TBEN;
-}
+    const uint32_t now = getCycleCount();
 
-void startCurrentTaskDuration()
-{
-    // stop timer, clear it, then start it again
-    disableTimer();
-    clearTimer();
-    enableTimer();
+    cpuCycles[taskCurrent] += now - taskStartCycles;
+    taskStartCycles = now;
 }
 
-uint32_t getCurrentTaskDuration()
+// Charges the time since enterKernelTime to the kernel, and starts counting
+// for whichever task runs next
+void exitKernelTime(void)
 {
-    //return duration of timer B
-    return intervalBLoad - WTIMER0_TBV_R;
+    const uint32_t now = getCycleCount();
+
+    cpuCycles[CPU_KERNEL] += now - taskStartCycles;
+    taskStartCycles = now;
 }
 
-void saveCurrentTaskDuration()
+// Starts a consistent read of the published cpu stats
+uint32_t readCpuStatsBegin(void)
 {
-    //Disable timer and store task's run time
-    tcb[taskCurrent].cpu_time[time_slot] += getCurrentTaskDuration();
+    uint32_t seq;
+
+    // Wait out an update in progress
+    do
+    {
+        seq = cpuStatsSeq;
+    } while (seq & 1);
+
+    return seq;
 }
 
-void finishCurrentTaskDuration()
+// True if the window closed during the read, which must then be repeated.
+// Never true for readers at the window timer's priority, like the svc calls.
+bool readCpuStatsRetry(uint32_t seq)
 {
-    //Disable timer and store task's run time
-    saveCurrentTaskDuration();
-    clearTimer();
-    disableTimer();
+    return cpuStatsSeq != seq;
 }
 
+// Cycles the task (or CPU_KERNEL) ran in the last finished window
 uint32_t getCpuTime(uint8_t task)
 {
-    return tcb[task].cpu_time[!time_slot];
+    return cpuTime[task];
 }
 
-void convertCpuTimeToPercent(uint32_t rawtime, uint8_t *integer, uint8_t *fraction)
+// Decayed share of the cpu, CPU_LOAD_ONE being all of it
+uint32_t getCpuLoad(uint8_t task, uint8_t window)
 {
-    // 1024 is an approximation of 1000 for performance purposes
-    *integer = rawtime*10 / 1024;
-    *fraction = rawtime - (*integer)*100;
-    // Hacky way to ensure it always has two decimal spots
-    if (*fraction >= 200) *fraction -= 200;
-    else if (*fraction >= 100) *fraction -= 100;
+    return cpuLoad[task][window];
 }
 
+// Length in cycles of the window getCpuTime reports on
+uint32_t getCpuWindow(void)
+{
+    return windowCycles;
+}
 
-void getCpuTimeAsPercent(uint8_t task, uint8_t *integer, uint8_t *fraction)
+// Folds a window's share into a fixed point average, as Linux does for
+// loadavg: load = load*decay + share*(1 - decay), rounded toward share
+uint32_t updateCpuLoad(uint32_t load, uint32_t share, uint32_t decay)
 {
-    // read inactive slot since its data is already finalized
-    const uint32_t time = getCpuTime(task);
-    convertCpuTimeToPercent(time, integer, fraction);
+    uint64_t next = (uint64_t)load*decay + (uint64_t)share*(CPU_LOAD_ONE - decay);
+
+    if (share >= load) next += CPU_LOAD_ONE - 1;
+
+    return next >> CPU_LOAD_SHIFT;
 }
 
-void wTimer0AIsr(void)
-{   
-    // Clear interrupt
-    WTIMER0_ICR_R |= TIMER_ICR_TATOCINT;
+// Publishes the window that just ended and starts the next
+void closeCpuWindow(void)
+{
+    const uint32_t now = getCycleCount();
+    uint32_t share;
+    int i, j;
+
+    // Time in this isr so far belongs to the window that is closing
+    cpuCycles[CPU_KERNEL] += now - taskStartCycles;
+    taskStartCycles = now;
+
+    cpuStatsSeq++;
 
-    // Save mid-task duration before timeslot change
-    saveCurrentTaskDuration();
-    clearTimer();
+    // Windows are measured rather than assumed, so percentages are exact
+    windowCycles = now - windowStartCycles;
+    windowStartCycles = now;
 
-    time_slot = !time_slot;
-    // Clear old time entries
-    int i;
-    for (i = 0; i < MAX_TASKS; i++)
+    for (i = 0; i <= CPU_KERNEL; i++)
     {
-        tcb[i].cpu_time[time_slot] = 0;
+        share = windowCycles ? ((uint64_t)cpuCycles[i] << CPU_LOAD_SHIFT) / windowCycles : 0;
+        if (share > CPU_LOAD_ONE) share = CPU_LOAD_ONE;
+
+        for (j = 0; j < CPU_LOAD_WINDOWS; j++)
+        {
+            cpuLoad[i][j] = updateCpuLoad(cpuLoad[i][j], share, cpuLoadDecay[j]);
+        }
+
+        cpuTime[i] = cpuCycles[i];
+        cpuCycles[i] = 0;
     }
+
+    cpuStatsSeq++;
 }
 
-void wTimer0BIsr(void)
+void wTimer0AIsr(void)
 {
+    enterKernelTime();
+
     // Clear interrupt
-    WTIMER0_ICR_R |= TIMER_ICR_TBTOCINT;
+    clearWindowTimer();
+
+    closeCpuWindow();
 
-    // INTERRUPT CURRENTLY UNUSED (DISABLED)
+    exitKernelTime();
 }
@@ -26,33 +26,47 @@
 #include "sys/clock.h"
 #include "util/str.h"
 
-extern bool time_slot;
-
 //-----------------------------------------------------------------------------
 // RTOS Defines and Kernel Variables
 //-----------------------------------------------------------------------------
 
 // task
 uint8_t taskCurrent = 0;          // index of last dispatched task
+uint8_t taskNext = 0;             // index of task chosen by the last pendsv
 uint8_t taskCount = 0;            // total number of valid tasks
 
 // control
 bool priorityScheduler = true;    // priority (true) or round-robin (false)
 bool priorityInheritance = false; // priority inheritance for mutexes
 bool preemption = true;          // preemption (true) or cooperative (false)
+bool ticklessIdle = false;        // stretch systick over idle time (true) or fixed 1ms tick (false)
 
 // tick count
 uint32_t tickCount = 0;
-uint8_t sleepingCount = 0;
+// delayed tasks, ordered by wake tick (earliest first)
+uint8_t sleepHead = NO_TASK;
+
+// systick
+#define TICK_CYCLES 40000                                   // 40MHz / 1kHz
+#define MAX_TICK_PERIOD ((NVIC_ST_RELOAD_M + 1) / TICK_CYCLES) // longest period the 24-bit reload allows
+uint32_t tickPeriod = 1;          // ticks covered by the systick period in progress
+bool tickReloadChanged = false;   // reload holds something other than 1 tick
 
-// last run for each priority level
-uint8_t lastRun[NUM_PRIORITIES] = {};
+// ready list head for each priority level (circular, doubly linked through tcb)
+uint8_t readyHead[NUM_PRIORITIES];
+// bit (31 - priority) is set while that priority's ready list is non-empty
+uint32_t readyPriorities = 0;
 
 //-----------------------------------------------------------------------------
 // Macros
 //-----------------------------------------------------------------------------
 
 #define isRunnable(x) (tcb[x].state == STATE_READY || tcb[x].state == STATE_UNRUN)
+#define priorityBit(p) (0x80000000 >> (p))
+// exception priority field values (3 priority bits, in the top of each byte)
+#define priorityField(p) ((uint32_t)(p) << 5u)
+// wrap-safe check of whether tick a comes before tick b
+#define tickBefore(a, b) ((int32_t)((a) - (b)) < 0)
 
 //-----------------------------------------------------------------------------
 // Subroutines
@@ -72,17 +86,46 @@ bool initMutex(uint8_t mutex)
 bool initSemaphore(uint8_t semaphore, uint8_t count)
 {
     bool ok = (semaphore < MAX_SEMAPHORES);
+    if (ok)
     {
         semaphores[semaphore].count = count;
     }
     return ok;
 }
 
+bool initEventGroup(uint8_t group, uint32_t flags)
+{
+    bool ok = (group < MAX_EVENT_GROUPS);
+    if (ok)
+    {
+        eventGroups[group].flags = flags;
+        eventGroups[group].waiters = 0;
+    }
+    return ok;
+}
+
+// depth 1 makes the queue a mailbox
+bool initQueue(uint8_t queue, uint8_t depth)
+{
+    bool ok = (queue < MAX_QUEUES && depth > 0 && depth <= MAX_QUEUE_DEPTH);
+    if (ok)
+    {
+        queues[queue].depth = depth;
+        queues[queue].count = 0;
+        queues[queue].head = 0;
+        queues[queue].highWater = 0;
+        queues[queue].owned = 0;
+        queues[queue].senders = 0;
+        queues[queue].receivers = 0;
+    }
+    return ok;
+}
+
 void initRtos(void)
 {
     uint8_t i;
 
-    const uint32_t stCycles = 40E6/1E3 - 1;
+    const uint32_t stCycles = TICK_CYCLES - 1;
 
     //Setup systick for 1ms
     NVIC_ST_RELOAD_R |= NVIC_ST_RELOAD_M & stCycles; //1ms tick
@@ -91,6 +134,13 @@ void initRtos(void)
     NVIC_ST_CTRL_R |= NVIC_ST_CTRL_INTEN; //enable systick interrupt
     NVIC_ST_CTRL_R |= NVIC_ST_CTRL_ENABLE; //enable systick
 
+    //Kernel exceptions share one priority so they never preempt each other,
+    //and pendsv sits below them so a context switch never delays an ISR
+    NVIC_SYS_PRI2_R = (NVIC_SYS_PRI2_R & ~NVIC_SYS_PRI2_SVC_M) | (priorityField(KERNEL_INT_PRIORITY) << 24);
+    NVIC_SYS_PRI3_R = (NVIC_SYS_PRI3_R & ~(NVIC_SYS_PRI3_TICK_M | NVIC_SYS_PRI3_PENDSV_M))
+                    | (priorityField(KERNEL_INT_PRIORITY) << 24)
+                    | (priorityField(PENDSV_INT_PRIORITY) << 16);
+
     // no tasks running
     taskCount = 0;
     // clear out tcb records
@@ -98,7 +148,106 @@ void initRtos(void)
     {
         tcb[i].state = STATE_INVALID;
         tcb[i].pid = 0;
+        tcb[i].readyNext = NO_TASK;
+        tcb[i].readyPrev = NO_TASK;
+        tcb[i].sleepNext = NO_TASK;
+    }
+    sleepHead = NO_TASK;
+
+    // empty ready lists
+    for (i = 0; i < NUM_PRIORITIES; i++)
+    {
+        readyHead[i] = NO_TASK;
+    }
+    readyPriorities = 0;
+
+    // heap free lists
+    initMemoryManager();
+
+    // measure kernel stack usage from here on
+    paintKernelStack();
+}
+
+// Appends a runnable task to the tail of its priority's ready list
+void addReadyTask(uint8_t task)
+{
+    const uint8_t prio = tcb[task].currentPriority;
+    const uint8_t head = readyHead[prio];
+
+    // already queued
+    if (tcb[task].readyNext != NO_TASK) return;
+
+    // Start timing wake to run latency
+    if (task != taskCurrent && !tcb[task].latencyPending)
+    {
+        tcb[task].latencyPending = true;
+        tcb[task].readyCycles = getCycleCount();
+    }
+
+    // A stretched tick can't time-slice or preempt, so reschedule now
+    if (tickPeriod > 1) triggerPendSv();
+
+    if (head == NO_TASK)
+    { // only task at this priority
+        tcb[task].readyNext = task;
+        tcb[task].readyPrev = task;
+        readyHead[prio] = task;
+        readyPriorities |= priorityBit(prio);
+    }
+    else
+    { // insert behind head, which is the tail of a circular list
+        const uint8_t tail = tcb[head].readyPrev;
+
+        tcb[task].readyNext = head;
+        tcb[task].readyPrev = tail;
+        tcb[tail].readyNext = task;
+        tcb[head].readyPrev = task;
+    }
+}
+
+// Unlinks a task from its priority's ready list
+void removeReadyTask(uint8_t task)
+{
+    const uint8_t prio = tcb[task].currentPriority;
+    const uint8_t next = tcb[task].readyNext;
+    const uint8_t prev = tcb[task].readyPrev;
+
+    // not queued
+    if (next == NO_TASK) return;
+
+    if (next == task)
+    { // last task at this priority
+        readyHead[prio] = NO_TASK;
+        readyPriorities &= ~priorityBit(prio);
+    }
+    else
+    {
+        tcb[prev].readyNext = next;
+        tcb[next].readyPrev = prev;
+        if (readyHead[prio] == task) readyHead[prio] = next;
+    }
+
+    tcb[task].readyNext = NO_TASK;
+    tcb[task].readyPrev = NO_TASK;
+}
+
+// Changes the effective priority of a task, moving it between ready lists if needed
+void setCurrentPriority(uint8_t task, uint8_t priority)
+{
+    if (tcb[task].currentPriority == priority) return;
+
+    if (tcb[task].readyNext != NO_TASK)
+    {
+        // Moving lists isn't a wakeup
+        const bool latencyPending = tcb[task].latencyPending;
+
+        removeReadyTask(task);
+        tcb[task].currentPriority = priority;
+        tcb[task].latencyPending = true;
+        addReadyTask(task);
+        tcb[task].latencyPending = latencyPending;
     }
+    else tcb[task].currentPriority = priority;
 }
 
 uint8_t rtosScheduler(void)
@@ -106,6 +255,10 @@ uint8_t rtosScheduler(void)
     bool ok;
     static uint8_t task = 0xFF;
     ok = false;
+
+    // Nothing is ready (no idle task): stay put rather than search an empty bitmap
+    if (readyPriorities == 0) return taskCurrent;
+
     if (!priorityScheduler) // Round Robin
     {
         while (!ok)
@@ -118,45 +271,57 @@ uint8_t rtosScheduler(void)
     }
     else // Priority Round Robin
     {
-        uint8_t i;
-        uint8_t lowestPrio = NUM_PRIORITIES - 1;
-        
-        // First pass, find lowest priority that is runnable
-        for (i = 0; i < MAX_TASKS; i++)
-        {
-            if (tcb[i].currentPriority < lowestPrio && isRunnable(i)) 
-            {
-                lowestPrio = tcb[i].currentPriority;
-                task = i; //Default in case second pass doesn't find a task
-            }
-        }
-
-        // Second pass, finds next task at lowestPrio priority level
-        // (modulo won't reduce performance since done on 2^n)
-        for (i = lastRun[lowestPrio] + 1; i % NUM_PRIORITIES != lastRun[lowestPrio]; i++)
-        {
-            if (tcb[i].currentPriority == lowestPrio && isRunnable(i))
-            {
-                task = i;
-                break;
-            }
-        }
+        // Highest ready priority is the first set bit of the bitmap (0=highest)
+        const uint8_t prio = countLeadingZeros(readyPriorities);
 
+        // Run the head and rotate the list so equal priorities take turns
+        task = readyHead[prio];
+        readyHead[prio] = tcb[task].readyNext;
     }
 
-    lastRun[tcb[task].currentPriority] = task;
-
     return task;
 }
 
+// Builds the exception frame a task is first dispatched from, as if it had been
+// switched out just before the first instruction of fn
+void initTaskStack(uint8_t task)
+{
+    uint32_t *sp = (uint32_t *)tcb[task].sp - TASK_FRAME_WORDS;
+
+    int i;
+    for (i = 0; i < TASK_FRAME_WORDS; i++) sp[i] = 0;
+
+    // r4-r11 (words 0-7) start cleared, then the hardware-stacked frame
+    sp[13] = 0;                                   // lr (tasks never return)
+    sp[14] = (uint32_t)tcb[task].pid & ~1;        // pc
+    sp[15] = 0x01000000;                          // xPSR (thumb bit)
+
+    tcb[task].sp = sp;
+}
+
+// Sets what a blocked task's svc call returns, through the r0 in its saved
+// frame (see initTaskStack), for calls completed by another task or isr
+void setTaskResult(uint8_t task, uint32_t result)
+{
+    if (task == taskCurrent) getPsp()[0] = result;
+    else ((uint32_t *)tcb[task].sp)[8] = result;
+}
+
 void startRtos(void)
 {
     //Choose task to run
     taskCurrent = rtosScheduler();
+    taskNext = taskCurrent;
+    tcb[taskCurrent].state = STATE_READY;
 
     applySramAccessMask(tcb[taskCurrent].srd);
+    applyReadOnlyWindow(tcb[taskCurrent].roBase, tcb[taskCurrent].roAttr);
 
-    setPsp(tcb[taskCurrent].sp);
+    //First task is started directly, so drop its initial frame
+    setPsp((uint32_t *)tcb[taskCurrent].sp + TASK_FRAME_WORDS);
+
+    // Don't count time spent before the rtos started
+    resetStats_impl();
 
     // Start tracking task duration
     startCurrentTaskDuration();
@@ -164,12 +329,14 @@ void startRtos(void)
     startRtosHelper(tcb[taskCurrent].pid);
 }
 
-bool createThread(_fn fn, const char name[], uint8_t priority, uint32_t stackBytes)
+// heapQuota caps the heap blocks the task can own, its stack included (0 = no limit)
+bool createThread(_fn fn, const char name[], uint8_t priority, uint32_t stackBytes, uint8_t heapQuota)
 {
     bool ok = false;
     uint8_t i = 0;
     bool found = false;
-    if (taskCount < MAX_TASKS)
+    void *stack;
+    if (taskCount < MAX_TASKS && priority < NUM_PRIORITIES)
     {
         // make sure fn not already in list (prevent reentrancy)
         while (!found && (i < MAX_TASKS))
@@ -185,9 +352,33 @@ bool createThread(_fn fn, const char name[], uint8_t priority, uint32_t stackByt
             tcb[i].state = STATE_UNRUN;
             tcb[i].pid = fn;
             tcb[i].srd = createNoSramAccessMask();
-            tcb[i].sp = mallocMemory(stackBytes, i); //malloc will update SRD appropiately
+            tcb[i].roBase = 0;
+            tcb[i].roAttr = 0;
+            tcb[i].heapQuota = 0; // the stack is always granted
+            tcb[i].heapBlocks = 0;
+            tcb[i].heapPeak = 0;
+            tcb[i].allocs = 0;
+            tcb[i].frees = 0;
+            tcb[i].allocFailures = 0;
+            stack = mallocMemory(stackBytes + STACK_GUARD_SIZE, i); //malloc will update SRD appropiately
+            if (!stack)
+            {
+                // No room for the stack: give the record back
+                tcb[i].state = STATE_INVALID;
+                tcb[i].pid = NULL;
+                return false;
+            }
+            if (STACK_GUARD_SIZE) removeSramAccessWindow(&tcb[i].srd, stack, STACK_GUARD_SIZE); //guard at the bottom
+            tcb[i].stackBase = (uint32_t *)((uint8_t *)stack + STACK_GUARD_SIZE);
+            tcb[i].stackSize = getAllocationSize(stack) - STACK_GUARD_SIZE;
+            tcb[i].stackUnused = tcb[i].stackSize;
+            paintStack(tcb[i].stackBase, tcb[i].stackSize);
+            tcb[i].heapQuota = heapQuota;
+            tcb[i].sp = (uint8_t *)tcb[i].stackBase + tcb[i].stackSize; //stack grows down from the top
+            initTaskStack(i);
             tcb[i].priority = priority;
             tcb[i].currentPriority = priority;
+            addReadyTask(i);
 
             //Copy name
             _strncpy(tcb[i].name, (char *)name, 16);
@@ -204,7 +395,7 @@ void killThread_impl(_fn fn)
 {
     int i;
 
-    uint8_t taskNum;
+    uint8_t taskNum = MAX_TASKS;
 
     // Find task index
     for (i = 0; i < MAX_TASKS; i++)
@@ -212,14 +403,14 @@ void killThread_impl(_fn fn)
         if (tcb[i].pid == fn) taskNum = i;
     }
 
+    if (taskNum >= MAX_TASKS) return;
+
     // Free malloced memory
     cleanupTaskMemory(taskNum);
 
     if (tcb[taskNum].state == STATE_DELAYED)
     { // clear sleep timer
-        tcb[taskNum].ticks = 0;
-
-        sleepingCount--;
+        removeSleepingTask(taskNum);
     }
     else if (tcb[taskNum].state == STATE_BLOCKED_MUTEX)
     { // remove from mutex queue
@@ -231,13 +422,26 @@ void killThread_impl(_fn fn)
         uint8_t sem_num = tcb[taskNum].semaphore;
         dequeue(semaphores[sem_num].processQueue, &semaphores[sem_num].queueSize, taskNum);
     }
+    else if (tcb[taskNum].state == STATE_BLOCKED_EVENT)
+    { // remove from event group waiters
+        eventGroups[tcb[taskNum].eventGroup].waiters &= ~(1 << taskNum);
+    }
+    else if (tcb[taskNum].state == STATE_BLOCKED_QUEUE)
+    { // remove from queue waiters and any timeout
+        removeQueueWaiter(taskNum);
+        removeSleepingTask(taskNum);
+    }
 
+    removeReadyTask(taskNum);
     tcb[taskNum].state = STATE_KILLED;
+
+    // Don't return to a dead task
+    if (taskNum == taskCurrent) triggerPendSv();
 }
 
 void restartThread_impl(_fn fn)
 {
-    uint8_t taskNum;
+    uint8_t taskNum = MAX_TASKS;
 
     // Find task index
     int i;
@@ -246,12 +450,16 @@ void restartThread_impl(_fn fn)
         if (tcb[i].pid == fn) taskNum = i;
     }
 
-    
-    if (taskNum < MAX_TASKS)
+    // Only a killed task can be restarted, its stack was kept for it
+    if (taskNum < MAX_TASKS && tcb[taskNum].state == STATE_KILLED)
     {
         // Start the program afresh
-        tcb[taskNum].sp = mallocMemory(1024, taskNum); //new stack
+        tcb[taskNum].stackUnused = tcb[taskNum].stackSize;
+        paintStack(tcb[taskNum].stackBase, tcb[taskNum].stackSize);
+        tcb[taskNum].sp = (uint8_t *)tcb[taskNum].stackBase + tcb[taskNum].stackSize;
+        initTaskStack(taskNum);
         tcb[taskNum].state = STATE_UNRUN; //set ready to run
+        addReadyTask(taskNum);
     }
 
 }
@@ -259,147 +467,208 @@ void restartThread_impl(_fn fn)
 void setThreadPriority_impl(_fn fn, uint8_t priority)
 {
     int i;
+
+    // The ready lists have one slot per priority
+    if (priority >= NUM_PRIORITIES) return;
+
     for (i = 0; i < MAX_TASKS; i++)
     {
         if (tcb[i].pid == fn)
         {
+            // Leave an inherited priority in place until the mutex is unlocked
+            if (tcb[i].currentPriority == tcb[i].priority) setCurrentPriority(i, priority);
             tcb[i].priority = priority;
         }
     }
 }
 
-void yield(void)
+// Changes the task's heap quota. Memory it already owns is kept, even over
+// the new quota, but further allocations fail until it is back under.
+void setHeapQuota_impl(_fn fn, uint8_t blocks)
 {
-    asm(" svc #0\n\t");
+    int i;
+    for (i = 0; i < MAX_TASKS; i++)
+    {
+        if (tcb[i].pid == fn) tcb[i].heapQuota = blocks;
+    }
 }
 
-void sleep(uint32_t tick)
-{
-    asm(" svc #1\n\t");
-}
+// svc call stubs, one per row of the svc table
+SVC_TABLE(SVC_STUB)
 
-void lock(int8_t mutex)
+// Queues a task to wake after the given number of ticks, keeping the queue in wake order
+void addSleepingTask(uint8_t task, uint32_t ticks)
 {
-    asm(" svc #2\n\t");
-}
+    uint8_t *link = &sleepHead;
 
-void unlock(int8_t mutex)
-{
-    asm(" svc #3\n\t");
-}
+    tcb[task].wakeTick = tickCount + ticks;
 
-void wait(int8_t semaphore)
-{
-    asm(" svc #4\n\t");
-}
+    // Tasks with the same wake tick keep the order they went to sleep in
+    while (*link != NO_TASK && !tickBefore(tcb[task].wakeTick, tcb[*link].wakeTick))
+    {
+        link = &tcb[*link].sleepNext;
+    }
 
-void post(int8_t semaphore)
-{
-    asm(" svc #5\n\t");
+    tcb[task].sleepNext = *link;
+    *link = task;
 }
 
-// read user input from uart0
-void readUart(uartData *data)
+// Takes a task out of the sleep queue before its wake tick
+void removeSleepingTask(uint8_t task)
 {
-    asm(" svc #6\n\t");
-}
+    uint8_t *link = &sleepHead;
 
-// read user input from uart0
-void write(char *str)
-{
-    asm(" svc #7\n\t");
-}
-void reboot()
-{
-    asm(" svc #8\n\t");
-}
-void ps()
-{
-    asm(" svc #9\n\t");
-}
-void ipcs()
-{
-    asm(" svc #10\n\t");
-}
-void kill(_fn fn)
-{
-    asm(" svc #11\n\t");
-}
-void pkill(char *proc_name, uint32_t size)
-{
-    asm(" svc #12\n\t");
-}
-void pi(bool on)
-{
-    asm(" svc #13\n\t");
-}
-void preempt(bool on)
-{
-    asm(" svc #14\n\t");
-}
-void sched(bool prio_on)
-{
-    asm(" svc #15\n\t");
-}
-void pidof(char *proc_name, uint32_t size)
-{
-    asm(" svc #16\n\t");
-}
-void run(char *name, uint32_t size)
-{
-    asm(" svc #17\n\t");
+    while (*link != NO_TASK && *link != task)
+    {
+        link = &tcb[*link].sleepNext;
+    }
+
+    if (*link == task) *link = tcb[task].sleepNext;
+    tcb[task].sleepNext = NO_TASK;
 }
-void mallocHeap(uint32_t size_in_bytes)
+
+// Returns the number of ticks a delayed task has left to sleep
+uint32_t getSleepTicksLeft(uint8_t task)
 {
-    asm(" svc #18\n\t");
+    return tcb[task].wakeTick - tickCount;
 }
-void freeHeap(void *ptr, uint32_t size)
+
+// Advances the tick count, waking any sleeping tasks whose time is up
+void advanceTicks(uint32_t ticks)
 {
-    asm(" svc #19\n\t");
+    tickCount += ticks;
+
+    // Only the head of the queue can be due
+    while (sleepHead != NO_TASK && !tickBefore(tickCount, tcb[sleepHead].wakeTick))
+    {
+        const uint8_t task = sleepHead;
+
+        sleepHead = tcb[task].sleepNext;
+        tcb[task].sleepNext = NO_TASK;
+
+        // A queue wait that timed out gives up its place on the queue
+        if (tcb[task].state == STATE_BLOCKED_QUEUE) timeoutQueueWait(task);
+
+        tcb[task].state = STATE_READY;
+        addReadyTask(task);
+    }
 }
-void killThread(_fn fn)
+
+// Ends a stretched systick period early, crediting the whole ticks that have elapsed.
+// The rest of the current tick still runs so the tick phase is kept.
+void syncTicks(void)
 {
-    asm(" svc #20\n\t");
+    uint32_t current, ticks, remaining;
+
+    if (tickPeriod <= 1) return;
+
+    // Read before the pending bit: a period that ends in between shows as pending
+    current = NVIC_ST_CURRENT_R;
+
+    if (NVIC_INT_CTRL_R & NVIC_INT_CTRL_PENDSTSET)
+    { // period already ran out, systickIsr will credit the last tick
+        ticks = tickPeriod - 1;
+        tickPeriod = 1;
+        advanceTicks(ticks);
+        return;
+    }
+
+    // Written to 0 but not reloaded yet, so the whole period is still to run
+    if (current == 0) current = NVIC_ST_RELOAD_R;
+
+    // programNextTick loaded the rest of a tick plus whole ticks, so tick
+    // boundaries fall where the count crosses a multiple of TICK_CYCLES
+    ticks = tickPeriod - 1 - (current - 1) / TICK_CYCLES;
+    remaining = (current - 1) % TICK_CYCLES + 1;
+    tickPeriod = 1;
+    advanceTicks(ticks);
+
+    // A reload of 0 would stop the counter, so the last cycle may run one long
+    NVIC_ST_RELOAD_R = (remaining > 1) ? remaining - 1 : 1;
+    NVIC_ST_CURRENT_R = 0;
+    tickReloadChanged = true;
 }
-void restartThread(_fn fn)
+
+// Returns the number of ticks until the next sleeping task wakes, or 0 if none sleep.
+// A sleeper that is already due (sleep(0)) still wakes on the next tick.
+uint32_t getTicksToNextWake(void)
 {
-    asm(" svc #21\n\t");
+    if (sleepHead == NO_TASK) return 0;
+    if (!tickBefore(tickCount, tcb[sleepHead].wakeTick)) return 1;
+
+    return getSleepTicksLeft(sleepHead);
 }
-void setThreadPriority(_fn fn, uint8_t priority)
+
+// Stretches the systick period up to the next wakeup when the running task
+// is the only one that needs the processor
+void programNextTick(void)
 {
-    asm(" svc #22\n\t");
+    uint32_t period, current;
+
+    // Another task at this priority still needs time slices
+    if (preemption && tcb[taskCurrent].readyNext != taskCurrent) return;
+    // Round robin slices between every runnable task
+    if (preemption && !priorityScheduler && readyPriorities != priorityBit(tcb[taskCurrent].currentPriority)) return;
+    // Let a pending tick land first
+    if (NVIC_INT_CTRL_R & NVIC_INT_CTRL_PENDSTSET) return;
+
+    // Nobody sleeping: the longest period. Otherwise never past the next wakeup
+    period = getTicksToNextWake();
+    if (period == 0 || period > MAX_TICK_PERIOD) period = MAX_TICK_PERIOD;
+    if (period <= 1) return;
+
+    // A count just restarted by syncTicks reads 0 until it reloads
+    current = NVIC_ST_CURRENT_R;
+    if (current == 0) current = NVIC_ST_RELOAD_R;
+
+    // Finish the tick in progress, then cover the remaining ticks in one interrupt
+    NVIC_ST_RELOAD_R = current + (period - 1) * TICK_CYCLES;
+    NVIC_ST_CURRENT_R = 0;
+    tickReloadChanged = true;
+    tickPeriod = period;
 }
 
 void systickIsr(void)
 {
-    tickCount++;
+    const uint32_t ticks = tickPeriod;
+
+    enterKernelTime();
 
-    //Keep track of sleeping programs
-    if (sleepingCount > 0)
+    // Return to 1ms ticks after a stretched or shortened period
+    if (tickReloadChanged)
     {
-        int i;
-        for (i = 0; i < MAX_TASKS; i++)
-        {
-            if (tcb[i].state == STATE_DELAYED && --(tcb[i].ticks) == 0)
-            {
-                tcb[i].state = STATE_READY;
-                sleepingCount--;
-            }
-        }
+        NVIC_ST_RELOAD_R = TICK_CYCLES - 1;
+        NVIC_ST_CURRENT_R = 0;
+        tickReloadChanged = false;
     }
+    tickPeriod = 1;
+
+    advanceTicks(ticks);
 
     //Preempt processes if needed
-    if (preemption) pendSvIsr();
+    if (preemption) triggerPendSv();
+
+    exitKernelTime();
 }
 
-//TODO: (optional) Add short-circuit if scheduler chooses
-//      same process to avoid unnecessary context switch
-void pendSvIsr()
+// First half of pendSvIsr (asm.s), called before any context is saved.
+// Returns false if the running task keeps the processor.
+uint8_t selectNextTask(void)
 {
-    // called from MPU
-    if (NVIC_FAULT_STAT_R & 0x03)
+    // The outgoing task's time ends here; exitKernelTime is called by
+    // switchTask, or below if nothing switches
+    enterKernelTime();
+
+    // Account for time spent in a stretched tick before rescheduling
+    syncTicks();
+
+    // called from MPU (access or exception stacking violation), or the task
+    // ran its stack below its base (into the guard, if there is one), where the
+    // privileged push of r4-r11 would land
+    if ((NVIC_FAULT_STAT_R & 0x13) || (tcb[taskCurrent].state != STATE_KILLED
+        && (uint32_t)getPsp() - 8*4 < (uint32_t)tcb[taskCurrent].stackBase))
     {
-        NVIC_FAULT_STAT_R |= 0x03; //Clear MPU status bits
+        NVIC_FAULT_STAT_R |= 0x13; //Clear MPU status bits
 
         killThread_impl(tcb[taskCurrent].pid);
 
@@ -409,116 +678,121 @@ void pendSvIsr()
 
     }
 
-    // context switch
+    // Select next task
+    taskNext = rtosScheduler();
 
-    // Save task time duration
-    finishCurrentTaskDuration();
+    // Same task keeps running, so there is no context to switch
+    if (taskNext == taskCurrent && tcb[taskNext].state != STATE_UNRUN)
+    {
+        recordWakeLatency(taskCurrent);
+        if (ticklessIdle) programNextTick();
+        exitKernelTime();
+        return SWITCH_NONE;
+    }
 
-    /*** Store context ***/
-    // Save callee regs
-    saveRegPendsv();
+    // A killed task's context is never restored, and its psp may already be
+    // below its stack, so nothing is pushed for it
+    return (tcb[taskCurrent].state == STATE_KILLED) ? SWITCH_DISCARD : SWITCH_SAVE;
+}
 
+// Second half of pendSvIsr (asm.s), called once r4-r11 of the outgoing task
+// are pushed onto its stack (or not, for a killed task). Returns the stack of the incoming task, which
+// pendSvIsr pops r4-r11 from.
+void *switchTask(void *sp)
+{
     // Save tcb state
-    tcb[taskCurrent].sp = getPsp();
-
-    // Select next task
-    taskCurrent = rtosScheduler();
+    tcb[taskCurrent].sp = sp;
 
-    /*** Restore context ***/
-    // Restore context for new task
-    setPsp(tcb[taskCurrent].sp);
+    taskCurrent = taskNext;
+    tcb[taskCurrent].switches++;
+    recordWakeLatency(taskCurrent);
 
     // Restore memory permissions
     applySramAccessMask(tcb[taskCurrent].srd);
+    applyReadOnlyWindow(tcb[taskCurrent].roBase, tcb[taskCurrent].roAttr);
 
-    //Perform first-run setup as needed
-    if (tcb[taskCurrent].state == STATE_UNRUN)
-    {
-        tcb[taskCurrent].state = STATE_READY;
-        initUnrunTask(tcb[taskCurrent].pid);
-    }
-    else
-    {
-        restoreRegPendsv();
-    }
+    // First run starts from the frame built by initTaskStack
+    if (tcb[taskCurrent].state == STATE_UNRUN) tcb[taskCurrent].state = STATE_READY;
 
-    // Start tracking task duration
-    startCurrentTaskDuration();
-}
+    // Sleep through idle time instead of taking every tick
+    if (ticklessIdle) programNextTick();
 
-void triggerPendSv(void)
-{
-    //Trigger pendSV interrupt
-    NVIC_INT_CTRL_R |= NVIC_INT_CTRL_PEND_SV; //Set PENDSV pending
+    // Start tracking the incoming task's duration
+    exitKernelTime();
+
+    return tcb[taskCurrent].sp;
 }
 
-// Ensures memory is owned by task who passed addr, and kills it if not
-// Returns whether the memory is owned by the task.
-bool ensurePointer(void *addr, uint32_t size)
+// Records how long a woken task waited between becoming ready and running
+void recordWakeLatency(uint8_t task)
 {
-    bool valid = true;
-    void *endAddr = (void *) ((uint32_t)addr + size - 1);
+    uint32_t latency;
 
-    // Check owner of beginning and end
-    valid &= getMemoryOwner(addr) == tcb[taskCurrent].pid;
-    valid &= getMemoryOwner(endAddr) == tcb[taskCurrent].pid;
+    if (!tcb[task].latencyPending) return;
+    tcb[task].latencyPending = false;
 
-    // Prevent overflow attack
-    valid &= endAddr >= addr;
+    latency = getCycleCount() - tcb[task].readyCycles;
 
-    // Kill offending task
-    if (!valid) killThread_impl(tcb[taskCurrent].pid);
+    if (latency < tcb[task].latencyMin) tcb[task].latencyMin = latency;
+    if (latency > tcb[task].latencyMax) tcb[task].latencyMax = latency;
+    tcb[task].latencySum += latency;
+    tcb[task].latencySamples++;
+}
 
-    return valid;
+// Clears the switch, svc and latency counters of every task
+void resetStats_impl(void)
+{
+    int i;
+    for (i = 0; i < MAX_TASKS; i++)
+    {
+        tcb[i].switches = 0;
+        tcb[i].svcCalls = 0;
+        tcb[i].latencyPending = false;
+        tcb[i].latencyMin = UINT32_MAX;
+        tcb[i].latencyMax = 0;
+        tcb[i].latencySamples = 0;
+        tcb[i].latencySum = 0;
+        tcb[i].heapPeak = tcb[i].heapBlocks;
+        tcb[i].allocs = 0;
+        tcb[i].frees = 0;
+        tcb[i].allocFailures = 0;
+    }
 }
 
-void svCallIsr(void)
+void triggerPendSv(void)
 {
-    uint8_t svcNum = getSvcNum();
-    union svc_param param = getSvcParam();
-    union svc_param2 param2 = getSvcParam2();
+    //Trigger pendSV interrupt (write-only bits, so no read-modify-write)
+    NVIC_INT_CTRL_R = NVIC_INT_CTRL_PEND_SV; //Set PENDSV pending
+}
 
-    switch (svcNum)
+// Ensures the task passing addr can write all size bytes of it, by testing the
+// range against the task's SRD mask. Stack, heap and read-write shared memory
+// pass; the kernel region, stack guards and other tasks' memory don't.
+// An input range the kernel only reads may also be in flash or the task's
+// read-only shared window.
+// Returns SVC_OK or the SVC_ERR_ code to hand back to the caller.
+int32_t ensurePointer(void *addr, uint32_t size, bool input)
+{
+    const uint32_t start = (uint32_t)addr - SRAM_BASE;
+    const uint32_t end = start + size - 1;
+    const uint32_t roSize = tcb[taskCurrent].roAttr ? 2u << ((tcb[taskCurrent].roAttr >> 1) & 0x1F) : 0;
+    uint32_t blocks;
+
+    if (size == 0) return SVC_OK;
+
+    if (input)
     {
-        case SVC_YIELD: yield_impl(); break;
-        case SVC_SLEEP: sleep_impl(param.uint32); break;
-        case SVC_LOCK: lock_impl(param.uint8); break;
-        case SVC_UNLOCK: unlock_impl(param.uint8); break;
-        case SVC_WAIT: wait_impl(param.uint8); break;
-        case SVC_POST: post_impl(param.uint8); break;
-
-        case SVC_READUART: readUart_impl(param.uart); break;
-        case SVC_WRITE:
-            if (ensurePointer(param.str, param2.size)) write_impl(param.str);
-            break;
-        case SVC_REBOOT: reboot_impl(); break;
-        case SVC_PS: ps_impl(); break;
-        case SVC_IPCS: ipcs_impl(); break;
-        case SVC_KILL: kill_impl(param.fn); break;
-        case SVC_PKILL: 
-            if (ensurePointer(param.str, param2.size)) pkill_impl(param.str);
-            break;
-        case SVC_PI: pi_impl(param.boolVal); break;
-        case SVC_PREEMPT: preempt_impl(param.boolVal); break;
-        case SVC_SCHED: sched_impl(param.boolVal); break;
-        case SVC_PIDOF:
-            if (ensurePointer(param.str, param2.size)) pidof_impl(param.str);
-            break;
-        case SVC_RUN: 
-            run_impl(param.str);
-            break;
-        case SVC_MALLOC: mallocHeap_impl(param.uint32); break;
-        case SVC_FREE:
-            if (ensurePointer(param.voidPtr, param2.size)) freeHeap_impl(param.voidPtr);
-            break;
-        case SVC_KILLTHREAD:
-            killThread_impl(param.fn);
-            break;
-        case SVC_RESTARTTHREAD:
-            restartThread_impl(param.fn);
-            break;
-        case SVC_SETTHREADPRIORITY:
-            setThreadPriority_impl(param.fn, param2.priority);
-            break;
+        if ((uint32_t)addr + size - 1 >= (uint32_t)addr && (uint32_t)addr + size <= FLASH_TOP) return SVC_OK;
+        if ((uint32_t)addr - tcb[taskCurrent].roBase < roSize
+            && size <= roSize - ((uint32_t)addr - tcb[taskCurrent].roBase)) return SVC_OK;
     }
+
+    // Must not wrap around or leave SRAM
+    if (end < start || end >= SRAM_SIZE) return SVC_ERR_RANGE;
+
+    // Bits first..last of the srd mask, every one of which must be enabled (clear)
+    blocks = (2u << (end/BLOCK_SIZE)) - (1u << (start/BLOCK_SIZE));
+    if ((uint32_t)tcb[taskCurrent].srd & blocks) return SVC_ERR_ACCESS;
+
+    return SVC_OK;
 }
@@ -20,9 +20,8 @@
 #include "tm4c123gh6pm.h"
 #include "sys/mm.h"
 #include "sys/kernel.h"
-
-#define MAX_BLOCKS 28
-#define SRAM_BASE 0x20000000
+#include "sys/asm.h"
+#include "util/str.h"
 
 //1-4 are SRAM regions
 #define SRAM_BOTTOM_REGION 1
@@ -31,84 +30,146 @@
 //8KiB each
 #define SRAM_REGION_SIZE 0x2000
 
-#define SRAM_DEFAULT_REGION_NUM 0
+//Attributes of an SRAM region with every subregion enabled:
+//full permissions, size = 2^(12+1) = 8KiB, region enabled
+#define SRAM_REGION_ATTR ((0x3 << 24) | (0xC << 1) | NVIC_MPU_ATTR_ENABLE)
+
+//Lowest priority region: only shows through where regions 1-4 have the
+//subregion disabled, which makes it a per-task read-only window onto SRAM
+#define SHARED_RO_REGION_NUM 0
 #define FLASH_REGION_NUM 5
 #define PERIPHERAL_REGION_NUM 6
 #define SRAM_KERNEL_REGION_NUM 7
 
-//Increasing heap_table index => decreasing memory address
-//heap_alloc_table[0] = HEAP_TOP = 0x20008000
-//heap_alloc_table[MAX_BLOCKS] = HEAP_BASE = 0x20001000
+//Increasing heap_table index => increasing memory address
+//heap_alloc_table[0] = HEAP_BASE = 0x20001000
+//heap_alloc_table[MAX_BLOCKS-1] = HEAP_TOP - BLOCK_SIZE = 0x20007C00
+
+//Buddy allocator over all of SRAM in BLOCK_SIZE units. A block of order n is
+//2^n KiB and aligned to 2^n KiB from SRAM_BASE, so it always starts on an MPU
+//subregion boundary. The kernel's 4KiB (blocks 0-3) is never on a free list,
+//which caps the largest heap block at 16KiB.
+#define SRAM_BLOCKS 32
+#define HEAP_FIRST_BLOCK ((HEAP_BASE - SRAM_BASE)/BLOCK_SIZE)
+#define NUM_ORDERS 5 //1, 2, 4, 8, 16 KiB
+#define NO_BLOCK 0xFF
+
+#define taskBit(task) ((uint16_t)1 << (task))
 
 heap_block heap_alloc_table[MAX_BLOCKS] = {0};
 
+//Free lists, one per order, doubly linked through the first block of each free block
+uint8_t freeHead[NUM_ORDERS];
+uint8_t freeNext[SRAM_BLOCKS];
+uint8_t freePrev[SRAM_BLOCKS];
+int8_t freeOrder[SRAM_BLOCKS]; //order of the free block starting here, -1 otherwise
+uint16_t freeBlocks = 0; //total free blocks across all lists
 
-void * mallocMemory(uint32_t size_in_bytes, uint8_t taskNum)
+mem_pool pools[MAX_POOLS] = {0};
+
+//SRD bits currently programmed into the SRAM regions (all disabled after setup)
+uint32_t appliedSrdMask = 0xFFFFFFFF;
+
+//Read-only window currently programmed into SHARED_RO_REGION_NUM
+uint32_t appliedRoBase = 0;
+uint32_t appliedRoAttr = 0;
+
+//How reallocHeap calls were served, since reset
+reallocCounts reallocStats = {0};
+
+
+//Pushes a free block of the given order onto its free list
+void addFreeBlock(uint8_t block, uint8_t order)
 {
-    //Grow from bottom to top.
-    //Bottom is reserved for kernel up to 0x20001000
-    const uint16_t num_blocks = (size_in_bytes-1)/BLOCK_SIZE + 1;
+    const uint8_t head = freeHead[order];
 
-    void *ret = NULL;
+    freeNext[block] = head;
+    freePrev[block] = NO_BLOCK;
+    if (head != NO_BLOCK) freePrev[head] = block;
+    freeHead[order] = block;
 
-    uint16_t count = 0, prevCount = UINT16_MAX, countTemp = 0;
-    int16_t start = -1, startTemp = 0;
+    freeOrder[block] = order;
+    freeBlocks += 1 << order;
+}
 
-    bool curr = false;
+//Unlinks a free block from its free list
+void removeFreeBlock(uint8_t block, uint8_t order)
+{
+    const uint8_t next = freeNext[block];
+    const uint8_t prev = freePrev[block];
 
-    //Find best fit continuous section
-    int i;
-    for (i = 0; i < MAX_BLOCKS; i++)
-    {
-        if (heap_alloc_table[i].isUsed == false && !curr)
-        {
-            curr = true;
+    if (prev != NO_BLOCK) freeNext[prev] = next;
+    else freeHead[order] = next;
+    if (next != NO_BLOCK) freePrev[next] = prev;
 
-            countTemp++;
-            startTemp = i;
-        }
-        else if (heap_alloc_table[i].isUsed == false && curr)
-        {
-            countTemp++;
-        }
+    freeOrder[block] = -1;
+    freeBlocks -= 1 << order;
+}
 
-        if ((heap_alloc_table[i].isUsed == true || i == MAX_BLOCKS-1) && curr)
-        {
-            curr = false;
+//Counts blocks the task has taken on, tracking its peak
+void addHeapUsage(uint8_t taskNum, uint8_t blocks)
+{
+    tcb[taskNum].heapBlocks += blocks;
+    if (tcb[taskNum].heapBlocks > tcb[taskNum].heapPeak) tcb[taskNum].heapPeak = tcb[taskNum].heapBlocks;
+}
 
-            if (countTemp < prevCount && countTemp >= num_blocks)
-            {
-                prevCount = count;
+void * mallocMemory(uint32_t size_in_bytes, uint8_t taskNum)
+{
+    const uint16_t num_blocks = (size_in_bytes-1)/BLOCK_SIZE + 1;
 
-                count = countTemp;
-                start = startTemp;
-            }
+    void *ret = NULL;
 
-            countTemp = 0;
-            startTemp = 0;
-        }
+    uint8_t order = 0, found, block;
 
-    }
+    //Smallest order that holds the request
+    while (order < NUM_ORDERS && (1 << order) < num_blocks) order++;
 
-    //Only return if we could successfully allocate; o/w defaults to NULL
-    if (count >= num_blocks)
+    //Smallest free block that fits
+    for (found = order; found < NUM_ORDERS && freeHead[found] == NO_BLOCK; found++);
+
+    //Fail on a bad size (num_blocks truncates past the heap), no memory,
+    //or going over the task's quota
+    if (size_in_bytes == 0 || size_in_bytes > MAX_ALLOC_SIZE || found >= NUM_ORDERS
+        || (taskNum != NO_TASK && tcb[taskNum].heapQuota && tcb[taskNum].heapBlocks + (1 << order) > tcb[taskNum].heapQuota))
     {
-        //Mark discovered blocks as allocated
-        for (i = start; i < start+num_blocks; i++)
-        {
-            heap_alloc_table[i].isUsed = true;
-            heap_alloc_table[i].pid = tcb[taskNum].pid;
-        }
+        if (taskNum != NO_TASK) tcb[taskNum].allocFailures++;
+        return NULL;
+    }
 
-        //Mark length of base allocation
-        heap_alloc_table[start].len = num_blocks;
+    block = freeHead[found];
+    removeFreeBlock(block, found);
 
-        ret = (void *)(HEAP_TOP - (start*BLOCK_SIZE));
+    //Split down to size, returning the upper halves to the free lists
+    while (found > order)
+    {
+        found--;
+        addFreeBlock(block + (1 << found), found);
+    }
 
-        //Add region to MPU SRD mask
-        addSramAccessWindow(&(tcb[taskNum].srd), ret, size_in_bytes);
+    //Mark discovered blocks as allocated (NO_TASK = kernel owned)
+    const uint8_t start = block - HEAP_FIRST_BLOCK;
+    int i;
+    for (i = start; i < start + (1 << order); i++)
+    {
+        heap_alloc_table[i].isUsed = true;
+        heap_alloc_table[i].pid = (taskNum == NO_TASK) ? NULL : tcb[taskNum].pid;
+        heap_alloc_table[i].sharers = 0;
+        heap_alloc_table[i].writers = 0;
     }
 
+    //Mark length of base allocation
+    heap_alloc_table[start].len = 1 << order;
+
+    //Return the lowest address, so the allocation is usable as a buffer
+    ret = (void *)(SRAM_BASE + (block*BLOCK_SIZE));
+
+    //Add region to MPU SRD mask and account it to the task
+    if (taskNum != NO_TASK)
+    {
+        addSramAccessWindow(&(tcb[taskNum].srd), ret, heap_alloc_table[start].len*BLOCK_SIZE);
+        addHeapUsage(taskNum, heap_alloc_table[start].len);
+        tcb[taskNum].allocs++;
+    }
 
     return ret;
 }
@@ -126,64 +187,730 @@ void * mallocHeap_impl(uint32_t size_in_bytes)
 
 void freeMemory(uint8_t index, uint8_t taskNum)
 {
-    //Remove memory access
-    removeSramAccessWindow(&(tcb[taskNum].srd), (uint32_t *)(HEAP_TOP-index*BLOCK_SIZE), heap_alloc_table[index].len*BLOCK_SIZE);
+    uint8_t block = index + HEAP_FIRST_BLOCK;
+    uint8_t order = 31 - countLeadingZeros(heap_alloc_table[index].len);
+    uint8_t buddy;
+
+    //Remove memory access and the task's usage
+    if (taskNum != NO_TASK)
+    {
+        removeSramAccessWindow(&(tcb[taskNum].srd), (uint32_t *)(HEAP_BASE+index*BLOCK_SIZE), heap_alloc_table[index].len*BLOCK_SIZE);
+        tcb[taskNum].heapBlocks -= heap_alloc_table[index].len;
+        tcb[taskNum].frees++;
+    }
 
-    //Mark all blocks as free (no need to clear PID field)
+    //Mark all blocks as free and unshared (no need to clear PID field)
     int i;
     for (i = index; i < index+heap_alloc_table[index].len; i++)
     {
         heap_alloc_table[i].isUsed = false;
+        heap_alloc_table[i].sharers = 0;
+        heap_alloc_table[i].writers = 0;
     }
 
     //Clear len field
     heap_alloc_table[index].len = 0;
+
+    //Coalesce with the buddy for as long as it is free and whole
+    while (order < NUM_ORDERS-1)
+    {
+        buddy = block ^ (1 << order);
+        if (freeOrder[buddy] != order) break;
+
+        removeFreeBlock(buddy, order);
+        block &= ~(1 << order);
+        order++;
+    }
+
+    addFreeBlock(block, order);
+}
+
+//Returns whether the block of order..newOrder-1 buddies above block are all free,
+//so the allocation at block can grow to newOrder without moving
+bool canGrowInPlace(uint8_t block, uint8_t order, uint8_t newOrder)
+{
+    for (; order < newOrder; order++)
+    {
+        //An upper half's buddy is below it, which would move the base
+        if (block & (1 << order)) return false;
+        if (freeOrder[block + (1 << order)] != order) return false;
+    }
+    return true;
 }
 
-void freeHeap_impl(void *address_from_malloc)
+//Resizes the allocation at index to 2^newOrder blocks without moving it,
+//absorbing free buddies to grow or returning upper halves to shrink
+void resizeInPlace(uint8_t index, uint8_t newOrder, uint8_t taskNum)
+{
+    const uint8_t block = index + HEAP_FIRST_BLOCK;
+    const uint16_t oldLen = heap_alloc_table[index].len;
+    const uint16_t newLen = 1 << newOrder;
+    uint8_t order = 31 - countLeadingZeros(oldLen);
+    int i;
+
+    if (newLen > oldLen)
+    {
+        for (; order < newOrder; order++) removeFreeBlock(block + (1 << order), order);
+
+        for (i = index + oldLen; i < index + newLen; i++)
+        {
+            heap_alloc_table[i].isUsed = true;
+            heap_alloc_table[i].pid = tcb[taskNum].pid;
+            heap_alloc_table[i].sharers = 0;
+            heap_alloc_table[i].writers = 0;
+        }
+        addSramAccessWindow(&(tcb[taskNum].srd), (uint32_t *)(HEAP_BASE+(index+oldLen)*BLOCK_SIZE), (newLen-oldLen)*BLOCK_SIZE);
+        addHeapUsage(taskNum, newLen - oldLen);
+    }
+    else
+    {
+        //The upper halves' buddies are the part being kept, so nothing coalesces
+        while (order > newOrder)
+        {
+            order--;
+            addFreeBlock(block + (1 << order), order);
+        }
+
+        for (i = index + newLen; i < index + oldLen; i++) heap_alloc_table[i].isUsed = false;
+        removeSramAccessWindow(&(tcb[taskNum].srd), (uint32_t *)(HEAP_BASE+(index+newLen)*BLOCK_SIZE), (oldLen-newLen)*BLOCK_SIZE);
+        tcb[taskNum].heapBlocks -= oldLen - newLen;
+    }
+
+    heap_alloc_table[index].len = newLen;
+}
+
+//Resizes an allocation of the caller's, keeping its contents up to the smaller
+//size. Grows in place when the buddies above it are free, otherwise moves it.
+//Shared allocations, pools and stacks can't be resized. Returns the new
+//address or NULL, leaving the allocation as it was, on failure.
+void * reallocHeap_impl(void *ptr, uint32_t size_in_bytes)
+{
+    const uint32_t index = getHeapIndex(ptr);
+    const uint16_t num_blocks = (size_in_bytes-1)/BLOCK_SIZE + 1;
+    uint8_t order, newOrder = 0;
+    uint32_t *from, *to;
+    void *ret;
+    int i;
+
+    if (!ptr) return mallocHeap_impl(size_in_bytes);
+
+    //Bigger than the largest buddy block never fits
+    if (size_in_bytes > MAX_ALLOC_SIZE)
+    {
+        reallocStats.failed++;
+        return NULL;
+    }
+
+    if (index >= MAX_BLOCKS || heap_alloc_table[index].len == 0
+        || heap_alloc_table[index].pid != tcb[taskCurrent].pid
+        || heap_alloc_table[index].sharers || getPoolByBase(ptr) >= 0
+        || getHeapIndex(tcb[taskCurrent].stackBase) - index < heap_alloc_table[index].len)
+    {
+        reallocStats.failed++;
+        return NULL;
+    }
+
+    if (size_in_bytes == 0)
+    {
+        freeHeap_impl(ptr, 0);
+        return NULL;
+    }
+
+    order = 31 - countLeadingZeros(heap_alloc_table[index].len);
+    while (newOrder < NUM_ORDERS && (1 << newOrder) < num_blocks) newOrder++;
+
+    //Shrinking, or growing into free buddies within the quota
+    if (newOrder <= order || (newOrder < NUM_ORDERS
+        && canGrowInPlace(index + HEAP_FIRST_BLOCK, order, newOrder)
+        && !(tcb[taskCurrent].heapQuota
+             && tcb[taskCurrent].heapBlocks + (1 << newOrder) - (1 << order) > tcb[taskCurrent].heapQuota)))
+    {
+        if (newOrder != order) resizeInPlace(index, newOrder, taskCurrent);
+        applySramAccessMask(tcb[taskCurrent].srd);
+        reallocStats.inPlace++;
+        return ptr;
+    }
+
+    //Move: both copies exist until the data is across
+    ret = mallocMemory(size_in_bytes, taskCurrent);
+    if (!ret)
+    {
+        reallocStats.failed++;
+        return NULL;
+    }
+
+    from = ptr;
+    to = ret;
+    for (i = 0; i < heap_alloc_table[index].len*BLOCK_SIZE/4; i++) to[i] = from[i];
+
+    freeMemory(index, taskCurrent);
+    applySramAccessMask(tcb[taskCurrent].srd);
+    reallocStats.moved++;
+
+    return ret;
+}
+
+// size bounds the allocation for callSvc's check; the table knows its length
+void freeHeap_impl(void *address_from_malloc, uint32_t size)
 {
     uint32_t start_index = getHeapIndex(address_from_malloc);
 
+    //Only the base of a live allocation: an interior pointer or a second free
+    //would find len == 0 and free a bogus order
+    if (start_index >= MAX_BLOCKS || (uint32_t)address_from_malloc != HEAP_BASE + start_index*BLOCK_SIZE
+        || !heap_alloc_table[start_index].isUsed || heap_alloc_table[start_index].len == 0) return;
+
+    //Pool memory only goes back through destroyPool, and the stack through kill
+    if (getPoolByBase(address_from_malloc) >= 0
+        || getHeapIndex(tcb[taskCurrent].stackBase) - start_index < heap_alloc_table[start_index].len) return;
+
     if (heap_alloc_table[start_index].pid == tcb[taskCurrent].pid)
     {
+        revokeSharers(start_index);
         freeMemory(start_index, taskCurrent);
         applySramAccessMask(tcb[taskCurrent].srd);
     }
 }
 
-// Free all memory allocated by the task
+// Free all memory allocated by the task, except its stack
 void cleanupTaskMemory(uint8_t taskNum)
 {
     _fn pid = tcb[taskNum].pid;
 
     int i;
+    // Drop the task's pools, which frees their memory
+    for (i = 0; i < MAX_POOLS; i++)
+    {
+        if (pools[i].base && pools[i].owner == taskNum) destroyMemoryPool(i);
+    }
+
     // Search through all memory blocks
     for (i = 0; i < MAX_BLOCKS; i++)
     {
-        // Free blocks owned by this pid
-        if (heap_alloc_table[i].pid == pid && heap_alloc_table[i].isUsed
-            && heap_alloc_table[i].len > 0)
+        if (!heap_alloc_table[i].isUsed || heap_alloc_table[i].len == 0) continue;
+
+        if (heap_alloc_table[i].pid == pid
+            && getHeapIndex(tcb[taskNum].stackBase) - i < heap_alloc_table[i].len)
         {
-            freeMemory(i, taskNum);
+            // The stack stays reserved so a restart gets the same memory back
+            revokeSharers(i);
         }
+        else if (heap_alloc_table[i].pid == pid)
+        {
+            // Shared memory outlives its owner: hand it to a sharer, else free it
+            if (heap_alloc_table[i].sharers) transferOwnership(i, taskNum);
+            else freeMemory(i, taskNum);
+        }
+        else if (heap_alloc_table[i].sharers & taskBit(taskNum))
+        {
+            removeSharer(i, taskNum);
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Stack usage
+//-----------------------------------------------------------------------------
+
+//Stacks are painted when created. The deepest point a stack reached is the
+//lowest word that no longer holds the paint, found by scanning up from the
+//bottom. Scans run on demand from ps, and stop at the previous high-water mark.
+
+//Linker symbols bounding the MSP stack (kernel, ISRs and main)
+extern uint32_t __stack;
+extern uint32_t __STACK_END;
+
+uint32_t kernelStackUnused = 0;
+
+//Returns how many bytes at the bottom of the stack still hold the paint,
+//starting from a known count (which can only shrink)
+uint32_t scanStack(uint32_t *base, uint32_t unused)
+{
+    uint32_t i = 0;
+
+    while (i < unused/4 && base[i] == STACK_PAINT) i++;
+
+    return i*4;
+}
+
+void paintStack(uint32_t *base, uint32_t size)
+{
+    uint32_t i;
+    for (i = 0; i < size/4; i++) base[i] = STACK_PAINT;
+}
+
+//Paints the unused part of the MSP stack, below where init is running now
+void paintKernelStack(void)
+{
+    //Leave room for this call's own frame
+    uint32_t *top = getMsp() - 8;
+
+    kernelStackUnused = (uint32_t)top - (uint32_t)&__stack;
+    paintStack(&__stack, kernelStackUnused);
+}
+
+//Returns the most bytes the task's stack has held
+uint32_t getStackPeak(uint8_t task)
+{
+    tcb[task].stackUnused = scanStack(tcb[task].stackBase, tcb[task].stackUnused);
+
+    return tcb[task].stackSize - tcb[task].stackUnused;
+}
+
+uint32_t getKernelStackSize(void)
+{
+    return (uint32_t)&__STACK_END - (uint32_t)&__stack;
+}
+
+//Returns the most bytes the MSP stack has held
+uint32_t getKernelStackPeak(void)
+{
+    kernelStackUnused = scanStack(&__stack, kernelStackUnused);
+
+    return getKernelStackSize() - kernelStackUnused;
+}
+
+//-----------------------------------------------------------------------------
+// Shared memory
+//-----------------------------------------------------------------------------
+
+//An allocation can be shared with other tasks. Read-write sharers get the
+//allocation's SRD window like the owner. Read-only sharers get it through
+//SHARED_RO_REGION_NUM, which needs a power of 2 sized, size aligned region:
+//exactly what the buddy allocator hands out. Each task has one read-only window.
+
+//Sets the sharer bits on every block of the allocation starting at index
+void setSharers(uint8_t index, uint16_t sharers, uint16_t writers)
+{
+    int i;
+    for (i = index; i < index+heap_alloc_table[index].len; i++)
+    {
+        heap_alloc_table[i].sharers = sharers;
+        heap_alloc_table[i].writers = writers;
+    }
+}
+
+//Takes a sharer's access to the allocation starting at index away
+void removeSharer(uint8_t index, uint8_t taskNum)
+{
+    const uint32_t base = HEAP_BASE + index*BLOCK_SIZE;
+
+    if (heap_alloc_table[index].writers & taskBit(taskNum))
+    {
+        removeSramAccessWindow(&(tcb[taskNum].srd), (uint32_t *)base, heap_alloc_table[index].len*BLOCK_SIZE);
+    }
+    if (tcb[taskNum].roBase == base)
+    {
+        tcb[taskNum].roBase = 0;
+        tcb[taskNum].roAttr = 0;
+    }
+
+    setSharers(index, heap_alloc_table[index].sharers & ~taskBit(taskNum),
+                      heap_alloc_table[index].writers & ~taskBit(taskNum));
+}
+
+//Takes every sharer's access away, before the allocation is freed
+void revokeSharers(uint8_t index)
+{
+    int i;
+    for (i = 0; i < MAX_TASKS; i++)
+    {
+        if (heap_alloc_table[index].sharers & taskBit(i)) removeSharer(index, i);
+    }
+}
+
+//Makes the lowest numbered sharer the owner of the allocation at index,
+//taking the old owner's access away
+void transferOwnership(uint8_t index, uint8_t taskNum)
+{
+    const uint32_t base = HEAP_BASE + index*BLOCK_SIZE;
+    const uint32_t size = heap_alloc_table[index].len*BLOCK_SIZE;
+    uint8_t owner = 0;
+    int i;
+
+    while (!(heap_alloc_table[index].sharers & taskBit(owner))) owner++;
+
+    removeSharer(index, owner);
+    removeSramAccessWindow(&(tcb[taskNum].srd), (uint32_t *)base, size);
+    addSramAccessWindow(&(tcb[owner].srd), (uint32_t *)base, size);
+
+    //Counts against the new owner even if that takes it over quota
+    tcb[taskNum].heapBlocks -= heap_alloc_table[index].len;
+    addHeapUsage(owner, heap_alloc_table[index].len);
+
+    for (i = index; i < index+heap_alloc_table[index].len; i++)
+    {
+        heap_alloc_table[i].pid = tcb[owner].pid;
+    }
+}
+
+//Grants the task called name access to an allocation the caller owns.
+//Returns SVC_ERR_ARG if ptr isn't the caller's allocation, there is no such
+//task, or a read-only share is asked for and the task already has one.
+int32_t shareHeap_impl(void *ptr, char *name, uint32_t size, bool writable)
+{
+    const uint32_t base = (uint32_t)ptr;
+    uint32_t index;
+    uint8_t task = NO_TASK;
+    int i;
+
+    //Only whole allocations of the caller's own, and never a pool or the stack
+    index = getHeapIndex(ptr);
+    if (index >= MAX_BLOCKS || base != HEAP_BASE + index*BLOCK_SIZE || heap_alloc_table[index].len == 0
+        || heap_alloc_table[index].pid != tcb[taskCurrent].pid || getPoolByBase(ptr) >= 0
+        || getHeapIndex(tcb[taskCurrent].stackBase) - index < heap_alloc_table[index].len) return SVC_ERR_ARG;
+
+    for (i = 0; i < MAX_TASKS; i++)
+    {
+        if (tcb[i].state != STATE_INVALID && _strcmp(name, tcb[i].name) == 0) task = i;
+    }
+    if (task == NO_TASK || task == taskCurrent) return SVC_ERR_ARG;
+
+    if (writable)
+    {
+        addSramAccessWindow(&(tcb[task].srd), (uint32_t *)base, heap_alloc_table[index].len*BLOCK_SIZE);
+        setSharers(index, heap_alloc_table[index].sharers | taskBit(task),
+                          heap_alloc_table[index].writers | taskBit(task));
+    }
+    else
+    {
+        if (tcb[task].roAttr && tcb[task].roBase != base) return SVC_ERR_ARG;
+
+        //Privileged RW, unprivileged RO, no execute, size = 2^(SIZE+1)
+        tcb[task].roBase = base;
+        tcb[task].roAttr = NVIC_MPU_ATTR_XN | (0x2 << 24)
+                         | ((9 + 31 - countLeadingZeros(heap_alloc_table[index].len)) << 1)
+                         | NVIC_MPU_ATTR_ENABLE;
+        setSharers(index, heap_alloc_table[index].sharers | taskBit(task),
+                          heap_alloc_table[index].writers);
+    }
+
+    return SVC_OK;
+}
+
+//-----------------------------------------------------------------------------
+// Message ownership
+//-----------------------------------------------------------------------------
+
+//A heap allocation sent through a message queue moves with the message: the
+//sender loses access once it is queued, the kernel owns it in transit and the
+//receiver is given it when the message is taken. Pool blocks, shared memory
+//and pointers into an allocation are passed on as they are.
+
+//Gives the allocation starting at ptr to the kernel, if taskNum owns it
+//outright (not its stack, a pool, or shared). Returns whether it did.
+bool detachAllocation(void *ptr, uint8_t taskNum)
+{
+    const uint32_t index = getHeapIndex(ptr);
+    const uint32_t base = HEAP_BASE + index*BLOCK_SIZE;
+    uint32_t size;
+    uint32_t i;
+
+    if (index >= MAX_BLOCKS || (uint32_t)ptr != base || heap_alloc_table[index].len == 0
+        || heap_alloc_table[index].pid != tcb[taskNum].pid || heap_alloc_table[index].sharers
+        || getPoolByBase(ptr) >= 0) return false;
+
+    size = heap_alloc_table[index].len*BLOCK_SIZE;
+    if ((uint32_t)tcb[taskNum].stackBase >= base && (uint32_t)tcb[taskNum].stackBase < base + size) return false;
+
+    removeSramAccessWindow(&(tcb[taskNum].srd), (uint32_t *)base, size);
+    tcb[taskNum].heapBlocks -= heap_alloc_table[index].len;
+
+    for (i = index; i < index+heap_alloc_table[index].len; i++)
+    {
+        heap_alloc_table[i].pid = NULL;
+    }
+
+    return true;
+}
+
+//Makes taskNum the owner of a detached allocation, even if that takes it over quota
+void attachAllocation(void *ptr, uint8_t taskNum)
+{
+    const uint32_t index = getHeapIndex(ptr);
+    uint32_t i;
+
+    addSramAccessWindow(&(tcb[taskNum].srd), (uint32_t *)ptr, heap_alloc_table[index].len*BLOCK_SIZE);
+    addHeapUsage(taskNum, heap_alloc_table[index].len);
+
+    for (i = index; i < index+heap_alloc_table[index].len; i++)
+    {
+        heap_alloc_table[i].pid = tcb[taskNum].pid;
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Fixed-size memory pools
+//-----------------------------------------------------------------------------
+
+//A pool is one heap allocation split into equal blocks, owned by a task (or
+//the kernel) through heap_alloc_table like any other allocation. The free
+//stack and allocated bitmap live in kernel memory. allocPoolBlock and
+//freePoolBlock are O(1) and guard the stack with BASEPRI at kernel priority,
+//so ISRs at kernel priority can use them.
+
+//Creates a pool of blockCount blocks of blockSize bytes (rounded up to 8)
+//owned by taskNum (NO_TASK for the kernel). Returns the pool number, -1 on failure.
+//Not callable from an ISR, since it allocates from the heap.
+int8_t createMemoryPool(uint8_t taskNum, uint16_t blockSize, uint8_t blockCount)
+{
+    int8_t pool = -1;
+    int i;
+
+    blockSize = (blockSize + 7) & ~7;
+    if (blockSize == 0 || blockCount == 0 || blockCount > MAX_POOL_BLOCKS) return -1;
+
+    for (i = 0; i < MAX_POOLS && pool < 0; i++)
+    {
+        if (pools[i].base == NULL) pool = i;
     }
+    if (pool < 0) return -1;
+
+    pools[pool].base = mallocMemory((uint32_t)blockSize*blockCount, taskNum);
+    if (pools[pool].base == NULL) return -1;
+
+    pools[pool].blockSize = blockSize;
+    pools[pool].blockCount = blockCount;
+    pools[pool].owner = taskNum;
+    pools[pool].allocated = 0;
+
+    //Lowest block on top of the stack
+    for (i = 0; i < blockCount; i++) pools[pool].freeStack[i] = blockCount-1 - i;
+    pools[pool].freeTop = blockCount;
+
+    return pool;
 }
 
-// Returns index of the memory block that addr resides in
+//Pops a free block, or returns NULL if the pool is exhausted
+void * allocPoolBlock(int8_t pool)
+{
+    mem_pool *p;
+    void *ret = NULL;
+    uint8_t index;
+
+    if (pool < 0 || pool >= MAX_POOLS) return NULL;
+    p = &pools[pool];
+
+    const uint32_t basepri = raiseBasepri();
+    if (p->base && p->freeTop > 0)
+    {
+        index = p->freeStack[--p->freeTop];
+        p->allocated |= (uint64_t)1 << index;
+        ret = p->base + index*p->blockSize;
+    }
+    restoreBasepri(basepri);
+
+    return ret;
+}
+
+//Pushes a block back. Returns false for pointers that aren't an allocated
+//block of this pool (foreign, misaligned or already free).
+bool freePoolBlock(int8_t pool, void *ptr)
+{
+    mem_pool *p;
+    uint32_t offset, index;
+    bool ok = false;
+
+    if (pool < 0 || pool >= MAX_POOLS) return false;
+    p = &pools[pool];
+
+    const uint32_t basepri = raiseBasepri();
+    offset = (uint8_t *)ptr - p->base;
+    index = p->base ? offset / p->blockSize : 0;
+    if (p->base && (uint8_t *)ptr >= p->base && index < p->blockCount
+        && offset % p->blockSize == 0 && (p->allocated & ((uint64_t)1 << index)))
+    {
+        p->allocated &= ~((uint64_t)1 << index);
+        p->freeStack[p->freeTop++] = index;
+        ok = true;
+    }
+    restoreBasepri(basepri);
+
+    return ok;
+}
+
+//Releases a pool and its memory; outstanding blocks become invalid
+void destroyMemoryPool(int8_t pool)
+{
+    mem_pool *p;
+    uint8_t *base;
+
+    if (pool < 0 || pool >= MAX_POOLS) return;
+    p = &pools[pool];
+    base = p->base;
+
+    const uint32_t basepri = raiseBasepri();
+    p->base = NULL;
+    p->freeTop = 0;
+    p->allocated = 0;
+    restoreBasepri(basepri);
+
+    if (base)
+    {
+        revokeSharers(getHeapIndex(base));
+        freeMemory(getHeapIndex(base), p->owner);
+    }
+}
+
+//Returns the pool whose memory starts at base, -1 if none
+int8_t getPoolByBase(void *base)
+{
+    int i;
+    for (i = 0; i < MAX_POOLS; i++)
+    {
+        if (pools[i].base && pools[i].base == base) return i;
+    }
+    return -1;
+}
+
+//Pool svc calls only act on pools the calling task owns
+bool ownsPool(int8_t pool)
+{
+    return pool >= 0 && pool < MAX_POOLS && pools[pool].base && pools[pool].owner == taskCurrent;
+}
+
+int32_t createPool_impl(uint32_t blockSize, uint32_t blockCount)
+{
+    int8_t pool;
+
+    if (blockSize > UINT16_MAX || blockCount > MAX_POOL_BLOCKS) return -1;
+
+    pool = createMemoryPool(taskCurrent, blockSize, blockCount);
+    applySramAccessMask(tcb[taskCurrent].srd);
+
+    return pool;
+}
+
+void * allocPool_impl(int8_t pool)
+{
+    if (!ownsPool(pool)) return NULL;
+    return allocPoolBlock(pool);
+}
+
+void freePool_impl(int8_t pool, void *ptr)
+{
+    if (ownsPool(pool)) freePoolBlock(pool, ptr);
+}
+
+void destroyPool_impl(int8_t pool)
+{
+    if (!ownsPool(pool)) return;
+
+    destroyMemoryPool(pool);
+    applySramAccessMask(tcb[taskCurrent].srd);
+}
+
+// Returns index of the memory block that addr resides in,
+// or MAX_BLOCKS if addr is outside the heap
 uint32_t getHeapIndex(void *addr)
 {
-    return (HEAP_TOP - (uint32_t)(addr))/BLOCK_SIZE;
+    if ((uint32_t)addr < HEAP_BASE || (uint32_t)addr >= HEAP_TOP) return MAX_BLOCKS;
+
+    return ((uint32_t)(addr) - HEAP_BASE)/BLOCK_SIZE;
+}
+
+// Returns size in bytes of the allocation starting at base
+uint32_t getAllocationSize(void *base)
+{
+    const uint32_t index = getHeapIndex(base);
+
+    return (index < MAX_BLOCKS) ? heap_alloc_table[index].len*BLOCK_SIZE : 0;
 }
 
 // Returns pid of task that owns the given memory
 _fn getMemoryOwner(void *addr)
 {
-    return heap_alloc_table[getHeapIndex(addr)].pid;
+    const uint32_t index = getHeapIndex(addr);
+
+    return (index < MAX_BLOCKS) ? heap_alloc_table[index].pid : NULL;
+}
+
+// Returns free heap space in bytes
+uint32_t getFreeHeap(void)
+{
+    return freeBlocks*BLOCK_SIZE;
 }
 
+// Returns the largest allocation that can currently succeed, in bytes
+uint32_t getLargestFreeBlock(void)
+{
+    int order;
+    for (order = NUM_ORDERS-1; order >= 0; order--)
+    {
+        if (freeHead[order] != NO_BLOCK) return (1 << order)*BLOCK_SIZE;
+    }
+    return 0;
+}
+
+// Returns external fragmentation in percent: the share of free memory that
+// lies outside the largest free block (0 = all free space is one block)
+uint8_t getHeapFragmentation(void)
+{
+    const uint32_t freeBytes = getFreeHeap();
+
+    if (freeBytes == 0) return 0;
+    return 100 - (getLargestFreeBlock()*100)/freeBytes;
+}
+
+// Copies the allocation table, each task's MPU windows and the heap totals
+// into the caller's snapshot
+void memInfo_impl(memInfoData *data)
+{
+    uint8_t owner;
+    int i, j;
+
+    data->allocationCount = 0;
+    for (i = 0; i < MAX_BLOCKS; i++)
+    {
+        if (!heap_alloc_table[i].isUsed || heap_alloc_table[i].len == 0) continue;
+
+        owner = NO_TASK;
+        for (j = 0; j < MAX_TASKS; j++)
+        {
+            if (heap_alloc_table[i].pid && tcb[j].pid == heap_alloc_table[i].pid) owner = j;
+        }
+
+        data->allocations[data->allocationCount].address = HEAP_BASE + i*BLOCK_SIZE;
+        data->allocations[data->allocationCount].size = heap_alloc_table[i].len*BLOCK_SIZE;
+        data->allocations[data->allocationCount].owner = owner;
+        data->allocations[data->allocationCount].sharers = heap_alloc_table[i].sharers;
+        data->allocations[data->allocationCount].writers = heap_alloc_table[i].writers;
+        data->allocationCount++;
+    }
+
+    for (i = 0; i < MAX_TASKS; i++)
+    {
+        if (tcb[i].state == STATE_INVALID) data->taskNames[i][0] = '\0';
+        else _strncpy(data->taskNames[i], tcb[i].name, 15);
+
+        data->srd[i] = (uint32_t)tcb[i].srd;
+        data->roBase[i] = tcb[i].roBase;
+        data->roSize[i] = tcb[i].roAttr ? (uint32_t)1 << (((tcb[i].roAttr >> 1) & 0x1F) + 1) : 0;
+    }
+
+    data->heapFree = getFreeHeap();
+    data->heapLargest = getLargestFreeBlock();
+    data->heapFragmentation = getHeapFragmentation();
+    data->realloc = reallocStats;
+}
+
+// Puts the heap (everything above the kernel's 4KiB) on the buddy free lists
 void initMemoryManager(void)
 {
+    uint8_t block;
+    int i;
+
+    for (i = 0; i < NUM_ORDERS; i++) freeHead[i] = NO_BLOCK;
+    for (i = 0; i < SRAM_BLOCKS; i++) freeOrder[i] = -1;
+    freeBlocks = 0;
 
+    //Largest aligned blocks first: 4KiB @ 4, 8KiB @ 8, 16KiB @ 16
+    block = HEAP_FIRST_BLOCK;
+    while (block < SRAM_BLOCKS)
+    {
+        addFreeBlock(block, 31 - countLeadingZeros(block));
+        block *= 2;
+    }
 }
 
 /*Creates a full-access MPU aperture for flash with
@@ -246,17 +973,42 @@ uint64_t createNoSramAccessMask(void)
 }
 
 //Applies the SRD bits to the MPUregions
+//Only regions whose SRD byte changed are rewritten. Each is written through its
+//own base/attr alias pair, selecting the region with the VALID bit instead of
+//a separate region number write and read-modify-write of the attributes.
 void applySramAccessMask(uint64_t srdBitMask)
 {
+    //BASE, ATTR, BASE1, ATTR1, BASE2, ATTR2, BASE3, ATTR3 are consecutive
+    volatile uint32_t *regionAlias = &NVIC_MPU_BASE_R;
+    const uint32_t changed = appliedSrdMask ^ (uint32_t)srdBitMask;
+
+    if (!changed) return;
+
     int i;
     for (i = 0; i < NUM_SRAM_REGIONS; i++)
     {
-        //Select region to modify
-        NVIC_MPU_NUMBER_R = i+SRAM_BOTTOM_REGION;
-        //Set respective SRD bits
-        NVIC_MPU_ATTR_R &= ~(0xFF << 8);
-        NVIC_MPU_ATTR_R |= ((srdBitMask >> i*8) & 0xFF) << 8;
+        if (!((changed >> i*8) & 0xFF)) continue;
+
+        regionAlias[2*i] = (SRAM_BASE + SRAM_REGION_SIZE*i) | NVIC_MPU_BASE_VALID | (i+SRAM_BOTTOM_REGION);
+        regionAlias[2*i+1] = SRAM_REGION_ATTR | (((srdBitMask >> i*8) & 0xFF) << 8);
     }
+    appliedSrdMask = (uint32_t)srdBitMask;
+
+    asm(" dsb\n\t"
+        " isb\n\t");
+}
+
+//Programs the task's read-only shared window into SHARED_RO_REGION_NUM,
+//skipping the write if the incoming task uses the same window
+void applyReadOnlyWindow(uint32_t base, uint32_t attr)
+{
+    if (base == appliedRoBase && attr == appliedRoAttr) return;
+
+    NVIC_MPU_BASE_R = base | NVIC_MPU_BASE_VALID | SHARED_RO_REGION_NUM;
+    NVIC_MPU_ATTR_R = attr;
+    appliedRoBase = base;
+    appliedRoAttr = attr;
+
     asm(" dsb\n\t"
         " isb\n\t");
 }
@@ -269,8 +1021,8 @@ void removeSramAccessWindow(uint64_t *srdBitMask, uint32_t *baseAdd, uint32_t si
     uint32_t length = ((uint32_t)size_in_bytes-1) / 1024 + 1;
 
     //Set corresponding bits
-    int i;
-    for (i = 0; i < length; i++) *srdBitMask |= (0x1 << (offset-1 - i));
+    uint32_t i;
+    for (i = 0; i < length; i++) *srdBitMask |= ((uint64_t)1 << (offset + i));
     
     asm(" dsb\n\t"
         " isb\n\t");
@@ -284,8 +1036,8 @@ void addSramAccessWindow(uint64_t *srdBitMask, uint32_t *baseAdd, uint32_t size_
     uint32_t length = ((uint32_t)size_in_bytes-1) / 1024 + 1;
 
     //Set corresponding bits
-    int i;
-    for (i = 0; i < length; i++) *srdBitMask &= ~(0x1 << (offset-1 - i));
+    uint32_t i;
+    for (i = 0; i < length; i++) *srdBitMask &= ~((uint64_t)1 << (offset + i));
     
     asm(" dsb\n\t"
         " isb\n\t");
@@ -316,13 +1068,10 @@ void initMpu(void)
     NVIC_MPU_ATTR_R |= 1 << 28; //Set XN (No execution)
     //Region kept disabled by default
 
-    //Setup default SRAM region (background region)
-    NVIC_MPU_NUMBER_R = SRAM_DEFAULT_REGION_NUM;
-    NVIC_MPU_BASE_R |= SRAM_BASE; // N = 0xF
-    NVIC_MPU_ATTR_R |= 0xE << 1; //Size = 2^(14+1) = 32KiB
-    NVIC_MPU_ATTR_R |= 0x1 << 24; //Privilege RW
-    NVIC_MPU_ATTR_R &= ~(0xFF << 8); //Enables all subregions
-    NVIC_MPU_ATTR_R |= NVIC_MPU_ATTR_ENABLE; //Enable region
+    //Shared read-only window, programmed per task at context switch
+    //(privileged SRAM access is already covered by the background rule)
+    NVIC_MPU_NUMBER_R = SHARED_RO_REGION_NUM;
+    NVIC_MPU_ATTR_R = 0; //Disabled until a task has a read-only share
 
     //Setup kernel SRAM region (full privileged access)
     NVIC_MPU_NUMBER_R = SRAM_KERNEL_REGION_NUM;
@@ -10,15 +10,16 @@
 #include "sys/clock.h"
 #include "sys/svc.h"
 #include "sys/kernel.h"
+#include "sys/mm.h"
+#include "sys/asm.h"
 #include "util/interface.h"
 #include "io/uart0.h"
 #include "util/str.h"
 
-extern uint32_t sleepingCount;
-
 extern bool priorityScheduler;
 extern bool priorityInheritance;
 extern bool preemption;
+extern bool ticklessIdle;
 
 uint8_t dequeue(uint8_t *queue, uint8_t *size, uint8_t index)
 {
@@ -45,9 +46,12 @@ void yield_impl(void)
 
 void sleep_impl(uint32_t tick)
 {
+    // Sleep is relative to now, not to the start of a stretched tick
+    syncTicks();
+
+    removeReadyTask(taskCurrent);
     tcb[taskCurrent].state = STATE_DELAYED;
-    tcb[taskCurrent].ticks = tick;
-    sleepingCount++;
+    addSleepingTask(taskCurrent, tick);
     
     triggerPendSv();
 }
@@ -69,12 +73,13 @@ void lock_impl(uint8_t mtx_num)
         // If owner has lower priority than task trying to lock, elevate owner priority
         if (priorityInheritance && tcb[taskCurrent].priority < tcb[mutexes[mtx_num].lockedBy].priority)
         {
-            tcb[mutexes[mtx_num].lockedBy].currentPriority = tcb[taskCurrent].currentPriority;
+            setCurrentPriority(mutexes[mtx_num].lockedBy, tcb[taskCurrent].currentPriority);
         }
 
         mutexes[mtx_num].processQueue[i] = taskCurrent;
         mutexes[mtx_num].queueSize++;
 
+        removeReadyTask(taskCurrent);
         tcb[taskCurrent].state = STATE_BLOCKED_MUTEX;
         tcb[taskCurrent].mutex = mtx_num;
 
@@ -86,12 +91,13 @@ void lock_impl(uint8_t mtx_num)
 void unlock_impl(uint8_t mtx_num) 
 {
     // Reset priority in case of inheritance
-    tcb[mutexes[mtx_num].lockedBy].currentPriority = tcb[mutexes[mtx_num].lockedBy].priority;
+    setCurrentPriority(mutexes[mtx_num].lockedBy, tcb[mutexes[mtx_num].lockedBy].priority);
 
     if (mutexes[mtx_num].queueSize > 0)
     {
         uint32_t procNum = dequeue(mutexes[mtx_num].processQueue, &mutexes[mtx_num].queueSize, 0);
         tcb[procNum].state = STATE_READY;
+        addReadyTask(procNum);
         
         mutexes[mtx_num].lockedBy = procNum;
     }
@@ -116,6 +122,7 @@ void wait_impl(uint8_t sem_num)
         semaphores[sem_num].processQueue[i] = taskCurrent;
         semaphores[sem_num].queueSize++;
 
+        removeReadyTask(taskCurrent);
         tcb[taskCurrent].state = STATE_BLOCKED_SEMAPHORE;
         tcb[taskCurrent].semaphore = sem_num;
 
@@ -131,6 +138,7 @@ void post_impl(uint8_t sem_num)
         const uint8_t procNum = dequeue(semaphores[sem_num].processQueue, &semaphores[sem_num].queueSize, 0);
 
         tcb[procNum].state = STATE_READY;
+        addReadyTask(procNum);
     }
     else 
     {
@@ -138,218 +146,361 @@ void post_impl(uint8_t sem_num)
     }
 }
 
-// Shell functions
-// read user input from uart0
-void readUart_impl(uartData *data)
+// Bits of the mask that satisfy a wait with these options, or 0
+uint32_t matchEvents(uint32_t flags, uint32_t mask, uint8_t options)
 {
-    data->isRxFull = UART0_FR_R & UART_FR_RXFF;
-    data->isRxEmpty = UART0_FR_R & UART_FR_RXFE;
-    data->isTxFull = UART0_FR_R & UART_FR_TXFF;
-    data->isTxEmpty = UART0_FR_R & UART_FR_TXFE;
+    const uint32_t matched = flags & mask;
 
-    data->error = UART0_RSR_R;
-    data->value = UART0_DR_R & 0xFF;
+    if (options & EVENT_WAIT_ALL) return (matched == mask) ? matched : 0;
+    return matched;
 }
 
-void write_impl(char *str)
+// Returns the bits that satisfied the wait. If none do yet, the caller blocks
+// until a set could satisfy it and gets 0, to retry once woken (see readLine).
+uint32_t waitEvents_impl(uint8_t group, uint32_t mask, uint8_t options)
 {
-    //TODO: Memory bounds/ownership check
-    putsUart0(str);
+    eventGroup *events;
+    uint32_t matched;
+
+    if (group >= MAX_EVENT_GROUPS || mask == 0) return 0;
+    events = &eventGroups[group];
+
+    matched = matchEvents(events->flags, mask, options);
+    if (matched)
+    {
+        if (options & EVENT_CLEAR) events->flags &= ~matched;
+        return matched;
+    }
+
+    events->waiters |= 1 << taskCurrent;
+    tcb[taskCurrent].eventGroup = group;
+    tcb[taskCurrent].eventMask = mask;
+    tcb[taskCurrent].eventOptions = options;
+
+    removeReadyTask(taskCurrent);
+    tcb[taskCurrent].state = STATE_BLOCKED_EVENT;
+
+    triggerPendSv();
+
+    return 0;
 }
-void reboot_impl(void)
+
+// Sets bits and readies each waiter they satisfy, found through the waiter
+// bits rather than a queue. Callable from kernel priority isrs; like post, it
+// leaves the reschedule to the caller.
+void setEvents_impl(uint8_t group, uint32_t mask)
 {
-    putsUart0("REBOOTING\n");
-    NVIC_APINT_R = NVIC_APINT_SYSRESETREQ | NVIC_APINT_VECTKEY;
+    eventGroup *events;
+    uint32_t waiters;
+    uint8_t task;
+
+    if (group >= MAX_EVENT_GROUPS) return;
+    events = &eventGroups[group];
+
+    events->flags |= mask;
+
+    waiters = events->waiters;
+    while (waiters)
+    {
+        task = 31 - countLeadingZeros(waiters);
+        waiters &= ~(1 << task);
+
+        if (matchEvents(events->flags, tcb[task].eventMask, tcb[task].eventOptions))
+        {
+            events->waiters &= ~(1 << task);
+            tcb[task].state = STATE_READY;
+            addReadyTask(task);
+        }
+    }
 }
-void ps_impl(void)
+
+// Clears bits and returns the flags as they were, so a mask of 0 reads them
+uint32_t clearEvents_impl(uint8_t group, uint32_t mask)
 {
-    int i;
-    const int fieldSize = 18;
+    uint32_t flags;
 
-    uint32_t kernel_rawtime = 0;
+    if (group >= MAX_EVENT_GROUPS) return 0;
 
-    uint8_t integer, fraction;
+    flags = eventGroups[group].flags;
+    eventGroups[group].flags &= ~mask;
 
-    // Field names
-    putFieldUart0("pid", fieldSize);
-    putFieldUart0("name", fieldSize);
-    putFieldUart0("state", fieldSize);
-    putFieldUart0("sleep time", fieldSize);
-    putFieldUart0("blocked on", fieldSize);
-    putFieldUart0("%CPU", fieldSize);
-    putsUart0("\n");
+    return flags;
+}
 
-    for (i = 0; i < MAX_TASKS; i++)
+// Message queues
+// A blocked send or receive is finished by whoever unblocks it: the message or
+// result goes straight into the waiter's stacked r0 (setTaskResult), so unlike
+// readLine the caller doesn't retry, and a timeout doesn't lose its place.
+
+// Highest priority task of the waiter bits, the lowest numbered on a tie
+uint8_t pickQueueWaiter(uint16_t waiters)
+{
+    uint8_t best = NO_TASK, task;
+
+    while (waiters)
     {
-        //Longest state name is 17 chars
-        char stateStr[18] = "INVALID";
-        int stateStrSize = 18;
+        task = 31 - countLeadingZeros(waiters);
+        waiters &= ~(1 << task);
 
-        if (tcb[i].pid)
-        {
-            putIntFieldUart0((uint32_t) tcb[i].pid, fieldSize);
-            putFieldUart0(tcb[i].name, fieldSize);
+        if (best == NO_TASK || tcb[task].currentPriority <= tcb[best].currentPriority) best = task;
+    }
 
-            // Display state as string
-            switch(tcb[i].state)
-            {
-                case STATE_INVALID:             
-                    _strncpy(stateStr,"INVALID", stateStrSize-1); break;
-                case STATE_UNRUN:               
-                    _strncpy(stateStr,"UNRUN", stateStrSize-1); break;
-                case STATE_READY:               
-                    _strncpy(stateStr,"READY", stateStrSize-1); break; 
-                case STATE_DELAYED:             
-                    _strncpy(stateStr,"DELAYED", stateStrSize-1); break;
-                case STATE_BLOCKED_SEMAPHORE:   
-                    _strncpy(stateStr,"BLOCKED_SEMAPHORE", stateStrSize-1); break;
-                case STATE_BLOCKED_MUTEX:       
-                    _strncpy(stateStr,"BLOCKED_MUTEX", stateStrSize-1); break;
-                case STATE_KILLED:             
-                     _strncpy(stateStr,"KILLED", stateStrSize-1); break;
-            }
-            putFieldUart0(stateStr, fieldSize);
+    return best;
+}
 
-            if (tcb[i].state == STATE_DELAYED) putIntFieldUart0(tcb[i].ticks, fieldSize);
-            else putFieldUart0("", fieldSize);
+void removeQueueWaiter(uint8_t task)
+{
+    queues[tcb[task].queue].senders &= ~(1 << task);
+    queues[tcb[task].queue].receivers &= ~(1 << task);
+}
 
-            // Display blocking resource
-            if (tcb[i].state == STATE_BLOCKED_MUTEX)
-            {
-                char temp[9] = "mutex[";
-                temp[6] = _itoc(tcb[i].mutex);
-                temp[7] = ']';
+// Readies a task blocked on a queue, with what its call returns
+void wakeQueueWaiter(uint8_t task, uint32_t result)
+{
+    removeSleepingTask(task);
+    setTaskResult(task, result);
+    tcb[task].state = STATE_READY;
+    addReadyTask(task);
+}
 
-                putFieldUart0(temp, fieldSize);
-            }
-            else if (tcb[i].state == STATE_BLOCKED_SEMAPHORE)
-            {
-                char temp[13] = "semaphore[";
-                temp[10] = _itoc(tcb[i].semaphore);
-                temp[11] = ']';
+// Called by advanceTicks when a queue wait runs out, before the task is readied
+void timeoutQueueWait(uint8_t task)
+{
+    const bool sending = queues[tcb[task].queue].senders & (1 << task);
 
-                putFieldUart0(temp, fieldSize);
-            }
-            else putFieldUart0("", fieldSize);
+    removeQueueWaiter(task);
+    setTaskResult(task, sending ? (uint32_t)SVC_ERR_TIMEOUT : 0);
+}
 
-            // Display CPU time
-            getCpuTimeAsPercent(i, &integer, &fraction);
+// Hands the message to the highest priority blocked receiver, or queues it.
+// An allocation the sender owns outright moves with it; sender is NO_TASK
+// from an isr, whose messages are passed as they are. Returns false if full.
+bool deliverMessage(uint8_t q, void *message, uint8_t sender)
+{
+    msgQueue *queue = &queues[q];
+    const uint8_t receiver = pickQueueWaiter(queue->receivers);
+    bool owned;
+    uint8_t slot;
 
-            kernel_rawtime += getCpuTime(i);
+    if (receiver == NO_TASK && queue->count == queue->depth) return false;
 
-            putIntUart0(integer);
-            putsUart0(".");
-            putIntUart0(fraction);
+    owned = (sender != NO_TASK) && detachAllocation(message, sender);
 
-            putsUart0("\n");
-        }
-        
+    // Receivers only wait on an empty queue, so this keeps the order
+    if (receiver != NO_TASK)
+    {
+        if (owned) attachAllocation(message, receiver);
+        queue->receivers &= ~(1 << receiver);
+        wakeQueueWaiter(receiver, (uint32_t)message);
+        return true;
     }
 
-    // Kernel time = remainder of time after subtracting all other programs
-    convertCpuTimeToPercent(10000-kernel_rawtime, &integer, &fraction);
+    slot = (queue->head + queue->count) % queue->depth;
+    queue->messages[slot] = message;
+    if (owned) queue->owned |= 1 << slot;
+    queue->count++;
+    if (queue->count > queue->highWater) queue->highWater = queue->count;
 
-    putFieldUart0("", fieldSize);
-    putFieldUart0("kernel", fieldSize);
-    putFieldUart0("", 3*fieldSize);
+    return true;
+}
 
-    // Display kernel CPU time
-    putIntUart0(integer);
-    putsUart0(".");
-    putIntUart0(fraction);
+void blockOnQueue(uint8_t q, uint32_t timeout)
+{
+    tcb[taskCurrent].queue = q;
+    removeReadyTask(taskCurrent);
+    tcb[taskCurrent].state = STATE_BLOCKED_QUEUE;
 
-    putsUart0("\n");
-    
+    // The timeout is relative to now, as for sleep
+    if (timeout != QUEUE_FOREVER)
+    {
+        syncTicks();
+        addSleepingTask(taskCurrent, timeout);
+    }
+
+    triggerPendSv();
 }
-void ipcs_impl(void)
+
+// Sends a message from a kernel priority isr without blocking. Ownership never
+// moves, so the message should be in a pool or buffer the receiver can reach.
+// Like post, it leaves the reschedule to the caller. Returns false if full.
+bool sendQueueFromIsr(uint8_t q, void *message)
 {
-    int i;
-    const int fieldSize = 16;
-    
-    // Field names
-    putsUart0("------ Mutexes ------\n");
-    putFieldUart0("index", fieldSize);
-    putFieldUart0("locked", fieldSize);
-    putFieldUart0("held by", fieldSize);
-    putFieldUart0("queue size", fieldSize);
-    putFieldUart0("waiting", fieldSize);
-    putsUart0("\n");
+    if (q >= MAX_QUEUES || queues[q].depth == 0) return false;
+
+    return deliverMessage(q, message, NO_TASK);
+}
+
+// Sends a message, waiting up to timeout ticks for room (0 to not wait,
+// QUEUE_FOREVER for no limit). Returns SVC_OK, SVC_ERR_TIMEOUT if it stayed
+// full, or SVC_ERR_ARG for a bad queue.
+int32_t sendQueue_impl(uint8_t q, void *message, uint32_t timeout)
+{
+    if (q >= MAX_QUEUES || queues[q].depth == 0) return SVC_ERR_ARG;
 
-    // Field values
-    for (i = 0; i < MAX_MUTEXES; i++)
+    if (deliverMessage(q, message, taskCurrent))
     {
-        // Index
-        putIntFieldUart0(i, fieldSize);
+        applySramAccessMask(tcb[taskCurrent].srd);
+        return SVC_OK;
+    }
 
-        // Whether locked or not
-        putFieldUart0(mutexes[i].lock ? "true" : "false", fieldSize);
+    if (timeout == 0) return SVC_ERR_TIMEOUT;
 
-        // Who's locking this mutex
-        if (mutexes[i].lockedBy < MAX_TASKS)
-        {
-            putFieldUart0(tcb[mutexes[i].lockedBy].name, fieldSize);
-        }
-        else
-        {
-            putFieldUart0("N/A", fieldSize);
-        }
+    tcb[taskCurrent].queueMessage = message;
+    queues[q].senders |= 1 << taskCurrent;
+    blockOnQueue(q, timeout);
 
-        // Queue size
-        putIntFieldUart0(mutexes[i].queueSize, fieldSize);
+    return SVC_ERR_TIMEOUT; // replaced by SVC_OK if a receiver makes room in time
+}
 
-        // Tasks in queue
-        int j;
-        if (mutexes[i].queueSize > 0)
-        {
-            putsUart0(tcb[mutexes[i].processQueue[0]].name);
-            for (j = 1; j < mutexes[i].queueSize; j++)
-            {
-                putsUart0(", ");
-                putsUart0(tcb[mutexes[i].processQueue[0]].name);
-            }
-        }
-        
-        putsUart0("\n");
-    }
+// Takes the oldest message, waiting up to timeout ticks for one. Returns NULL
+// on a timeout or a bad queue, so a NULL message can't be told apart.
+void * receiveQueue_impl(uint8_t q, uint32_t timeout)
+{
+    msgQueue *queue;
+    void *message;
+    uint8_t sender;
 
-    // Separator
-    putsUart0("\n");
+    if (q >= MAX_QUEUES || queues[q].depth == 0) return NULL;
+    queue = &queues[q];
 
-    // Semaphores
-    putsUart0("------ Semaphores ------\n");
-    putFieldUart0("index", fieldSize);
-    putFieldUart0("count", fieldSize);
-    putFieldUart0("queue size", fieldSize);
-    putFieldUart0("waiting", fieldSize);
-    putsUart0("\n");
+    if (queue->count == 0)
+    {
+        if (timeout == 0) return NULL;
+
+        queue->receivers |= 1 << taskCurrent;
+        blockOnQueue(q, timeout);
 
-    // Field values
-    for (i = 0; i < MAX_SEMAPHORES; i++)
+        return NULL; // replaced by the message if one is sent in time
+    }
+
+    message = queue->messages[queue->head];
+    if (queue->owned & (1 << queue->head)) attachAllocation(message, taskCurrent);
+    queue->owned &= ~(1 << queue->head);
+    queue->head = (queue->head + 1) % queue->depth;
+    queue->count--;
+
+    // The free slot lets the highest priority blocked sender finish
+    sender = pickQueueWaiter(queue->senders);
+    if (sender != NO_TASK)
     {
-        // Index
-        putIntFieldUart0(i, fieldSize);
+        queue->senders &= ~(1 << sender);
+        deliverMessage(q, tcb[sender].queueMessage, sender);
+        wakeQueueWaiter(sender, SVC_OK);
+    }
 
-        // Sema count
-        putIntFieldUart0(semaphores[i].count, fieldSize);
+    applySramAccessMask(tcb[taskCurrent].srd);
 
-        // Queue size
-        putIntFieldUart0(semaphores[i].queueSize, fieldSize);
+    return message;
+}
 
-        // Tasks in queue
-        int j;
-        if (semaphores[i].queueSize > 0)
+// Shell functions
+// read user input from uart0
+// Copies the next typed line from uart0. If none is ready the caller blocks on
+// uartRxLine and retries once woken. Returns whether a line was copied.
+int32_t readLine_impl(char *str, uint32_t size)
+{
+    const bool ok = readUart0Line(str, size);
+
+    if (!ok) wait_impl(uartRxLine);
+
+    return ok;
+}
+
+// Queues bytes for uart0. If the tx ring fills, the caller blocks on uartTxSpace
+// and retries the remainder once woken. Returns the number of bytes queued.
+int32_t write_impl(char *str, uint32_t size)
+{
+    const uint32_t count = writeUart0(str, size);
+
+    if (count < size) wait_impl(uartTxSpace);
+
+    return count;
+}
+void reboot_impl(void)
+{
+    putsUart0("REBOOTING\n");
+    NVIC_APINT_R = NVIC_APINT_SYSRESETREQ | NVIC_APINT_VECTKEY;
+}
+// Copies the task table into the caller's snapshot; formatting is left to the caller
+void ps_impl(psData *data)
+{
+    int i, j;
+    uint32_t seq;
+    psTask *task;
+
+    data->taskCount = 0;
+
+    for (i = 0; i < MAX_TASKS; i++)
+    {
+        if (tcb[i].pid)
         {
-            putsUart0(tcb[semaphores[i].processQueue[0]].name);
-            for (j = 1; j < semaphores[i].queueSize; j++)
-            {
-                putsUart0(", ");
-                putsUart0(tcb[semaphores[i].processQueue[0]].name);
-            }
+            task = &data->tasks[data->taskCount++];
+
+            task->pid = tcb[i].pid;
+            _strncpy(task->name, tcb[i].name, 15);
+            task->state = tcb[i].state;
+            task->mutex = tcb[i].mutex;
+            task->semaphore = tcb[i].semaphore;
+            task->eventGroup = tcb[i].eventGroup;
+            task->queue = tcb[i].queue;
+            task->sleepTicks = (tcb[i].state == STATE_DELAYED) ? getSleepTicksLeft(i) : 0;
+            task->switches = tcb[i].switches;
+            task->svcCalls = tcb[i].svcCalls;
+            task->latencyMin = tcb[i].latencyMin;
+            task->latencyMax = tcb[i].latencyMax;
+            task->latencySamples = tcb[i].latencySamples;
+            task->latencySum = tcb[i].latencySum;
+            task->stackSize = tcb[i].stackSize;
+            task->stackPeak = getStackPeak(i);
+            task->heapQuota = tcb[i].heapQuota;
+            task->heapBlocks = tcb[i].heapBlocks;
+            task->heapPeak = tcb[i].heapPeak;
+            task->allocs = tcb[i].allocs;
+            task->frees = tcb[i].frees;
+            task->allocFailures = tcb[i].allocFailures;
         }
-
-        putsUart0("\n");   
     }
 
+    // Cpu stats come from one window, even if it closes part way through
+    do
+    {
+        seq = readCpuStatsBegin();
+
+        for (i = 0, task = data->tasks; i < MAX_TASKS; i++)
+        {
+            if (!tcb[i].pid) continue;
+
+            task->cpuTime = getCpuTime(i);
+            for (j = 0; j < CPU_LOAD_WINDOWS; j++) task->cpuLoad[j] = getCpuLoad(i, j);
+            task++;
+        }
+
+        data->windowCycles = getCpuWindow();
+        data->kernelCpuTime = getCpuTime(CPU_KERNEL);
+        for (j = 0; j < CPU_LOAD_WINDOWS; j++) data->kernelCpuLoad[j] = getCpuLoad(CPU_KERNEL, j);
+    } while (readCpuStatsRetry(seq));
+
+    data->heapFree = getFreeHeap();
+    data->heapLargest = getLargestFreeBlock();
+    data->heapFragmentation = getHeapFragmentation();
+
+    data->kernelStackSize = getKernelStackSize();
+    data->kernelStackPeak = getKernelStackPeak();
+}
+
+// Copies the mutex, semaphore, event group, queue and uart0 state into the caller's snapshot
+void ipcs_impl(ipcsData *data)
+{
+    int i;
+
+    for (i = 0; i < MAX_MUTEXES; i++) data->mutexes[i] = mutexes[i];
+    for (i = 0; i < MAX_SEMAPHORES; i++) data->semaphores[i] = semaphores[i];
+    for (i = 0; i < MAX_EVENT_GROUPS; i++) data->eventGroups[i] = eventGroups[i];
+    for (i = 0; i < MAX_TASKS; i++) data->eventMasks[i] = tcb[i].eventMask;
+    for (i = 0; i < MAX_QUEUES; i++) data->queues[i] = queues[i];
+    for (i = 0; i < MAX_TASKS; i++) _strncpy(data->taskNames[i], tcb[i].name, 15);
+
+    data->uart = uart0Stats;
 }
 void kill_impl(_fn pid)
 {
@@ -388,7 +539,8 @@ void kill_impl(_fn pid)
 
     putsUart0("\n");
 }
-void pkill_impl(char *proc_name)
+// size bounds proc_name for callSvc's check
+void pkill_impl(char *proc_name, uint32_t size)
 {
     uint8_t taskNum = UINT8_MAX;
 
@@ -464,7 +616,21 @@ void sched_impl(bool prio_on)
         priorityScheduler = false;
     }
 }
-void pidof_impl(char *proc_name)
+void tickless_impl(bool on)
+{
+    if (on)
+    {
+        putsUart0("tickless on\n");
+        ticklessIdle = true;
+    }
+    else
+    {
+        putsUart0("tickless off\n");
+        ticklessIdle = false;
+    }
+}
+// size bounds proc_name for callSvc's check
+void pidof_impl(char *proc_name, uint32_t size)
 {
     uint32_t pid = 0;
 
@@ -488,7 +654,8 @@ void pidof_impl(char *proc_name)
     putsUart0("\n");
 }
 
-void run_impl(char *name)
+// size bounds name for callSvc's check
+void run_impl(char *name, uint32_t size)
 {
     int i;
     bool found = false;
@@ -526,3 +693,64 @@ void run_impl(char *name)
     }
 
 }
+
+// Cycle count for timing from tasks, which can't read the counter themselves
+uint32_t cycles_impl(void)
+{
+    return getCycleCount();
+}
+
+// One typed thunk per svc call, so handlers are never called through a cast
+SVC_TABLE(SVC_THUNK)
+
+// svc dispatch table, indexed by svc number
+static const svc_entry svcTable[SVC_COUNT] =
+{
+    SVC_TABLE(SVC_DISPATCH)
+};
+
+// Validates and runs the svc call whose stacked registers are at frame
+void callSvc(uint32_t *frame)
+{
+    uint8_t svcNum = ((uint8_t *)frame[6])[-2]; // svc #imm is the instruction before the stacked pc
+    const svc_entry *entry;
+    uint32_t size;
+    int32_t err;
+
+    if (svcNum >= SVC_COUNT) return;
+    entry = &svcTable[svcNum];
+
+    tcb[taskCurrent].svcCalls++;
+
+    // Reject an index past the end of the table it selects. A negative id
+    // is sign extended by the stub, so it is out of range too.
+    if (entry->check.indexArg != SVC_NO_ARG && frame[entry->check.indexArg] >= entry->check.indexCount)
+    {
+        frame[0] = SVC_ERR_ARG;
+        return;
+    }
+
+    // Validate the pointer argument, if the call takes one
+    if (entry->check.ptrArg != SVC_NO_ARG)
+    {
+        size = entry->check.size;
+        if (entry->check.sizeArg != SVC_NO_ARG) size += frame[entry->check.sizeArg];
+
+        err = ensurePointer((void *)frame[entry->check.ptrArg], size, entry->check.input);
+        if (err != SVC_OK)
+        {
+            frame[0] = err;
+            return;
+        }
+    }
+
+    // Return value goes back to the caller through the stacked r0
+    entry->handler(frame);
+}
+
+void svCallIsr(void)
+{
+    enterKernelTime();
+    callSvc(getPsp());
+    exitKernelTime();
+}
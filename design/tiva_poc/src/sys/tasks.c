@@ -56,6 +56,13 @@ void initHw(void)
     setPinAuxFunction(PORTB, 6, 4); //M0PWM0 PCTRL value
 }
 
+// Sets up the kernel objects the tasks share, before any task runs
+void initTasks(void)
+{
+    // No key is down yet, so readKeys's first wait for KEY_RELEASED returns at once
+    initEventGroup(keyEvents, KEY_RELEASED);
+}
+
 uint8_t readPbs(void)
 {
     uint8_t read = 0;
@@ -79,6 +86,8 @@ void idle(void)
         setPinValue(ORANGE_LED, 1);
         waitMicrosecond(1000);
         setPinValue(ORANGE_LED, 0);
+        // sleep until the next interrupt (a stretched tick when tickless is on)
+        asm(" wfi\n\t");
         yield();
     }
 }
@@ -131,14 +140,14 @@ void readKeys(void)
     uint8_t buttons;
     while(true)
     {
-        wait(keyReleased);
+        while (!waitEvents(keyEvents, KEY_RELEASED, EVENT_CLEAR));
         buttons = 0;
         while (buttons == 0)
         {
             buttons = readPbs();
             yield();
         }
-        post(keyPressed);
+        setEvents(keyEvents, KEY_PRESSED);
         if ((buttons & 1) != 0)
         {
             setPinValue(YELLOW_LED, !getPinValue(YELLOW_LED));
@@ -170,7 +179,7 @@ void debounce(void)
     uint8_t count;
     while(true)
     {
-        wait(keyPressed);
+        while (!waitEvents(keyEvents, KEY_PRESSED, EVENT_CLEAR));
         count = 10;
         while (count != 0)
         {
@@ -180,7 +189,7 @@ void debounce(void)
             else
                 count = 10;
         }
-        post(keyReleased);
+        setEvents(keyEvents, KEY_RELEASED);
     }
 }
 
@@ -0,0 +1,184 @@
+// Ahmed Abdulla
+// Copyright 2025 Ahmed Abdulla. All Rights Reserved.
+// (Excluding work produced by Professor Jason Losh)
+//
+// Small object allocator
+// Each size class keeps its own pages. Only a new page or an empty page going
+// back makes an svc call; every other alloc/free stays in the task.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "util/slab.h"
+#include "sys/kernel.h"
+
+#define SLAB_NONE 0xFF
+
+#define objectSize(page) (SLAB_MIN_SIZE << (page)->sizeClass)
+#define objectCount(page) (SLAB_PAGE_SIZE / objectSize(page))
+
+void initSlabHeap(slabHeap *heap)
+{
+    int i;
+    for (i = 0; i < SLAB_MAX_PAGES; i++) heap->pages[i].base = NULL;
+    for (i = 0; i < SLAB_NUM_CLASSES; i++) heap->partial[i] = SLAB_NO_PAGE;
+}
+
+// Returns a page of the class with free objects, other than skip, or SLAB_NO_PAGE
+uint8_t findPartialPage(const slabHeap *heap, uint8_t sizeClass, uint8_t skip)
+{
+    uint8_t i;
+
+    for (i = 0; i < SLAB_MAX_PAGES; i++)
+    {
+        if (i != skip && heap->pages[i].base && heap->pages[i].sizeClass == sizeClass
+            && heap->pages[i].freeCount > 0) return i;
+    }
+    return SLAB_NO_PAGE;
+}
+
+// Gets a page from the heap and threads every object onto its free list
+// Returns its descriptor, or SLAB_NO_PAGE if there is no descriptor or memory
+uint8_t addSlabPage(slabHeap *heap, uint8_t sizeClass)
+{
+    slabPage *page;
+    uint8_t p;
+    int i;
+
+    for (p = 0; p < SLAB_MAX_PAGES && heap->pages[p].base; p++);
+    if (p == SLAB_MAX_PAGES) return SLAB_NO_PAGE;
+
+    page = &heap->pages[p];
+    page->base = mallocHeap(SLAB_PAGE_SIZE);
+    if (!page->base) return SLAB_NO_PAGE;
+
+    page->sizeClass = sizeClass;
+    page->freeCount = objectCount(page);
+    page->freeHead = 0;
+
+    for (i = 0; i < page->freeCount; i++)
+    {
+        page->base[i*objectSize(page)] = (i+1 < page->freeCount) ? i+1 : SLAB_NONE;
+    }
+
+    heap->partial[sizeClass] = p;
+    return p;
+}
+
+// Returns an object of at least size bytes, or NULL if none is available
+// Requests above SLAB_MAX_SIZE go straight to mallocHeap
+void *slabAlloc(slabHeap *heap, uint32_t size)
+{
+    slabPage *page;
+    uint8_t sizeClass = 0, p;
+    uint8_t *object;
+
+    if (size == 0) return NULL;
+    if (size > SLAB_MAX_SIZE) return mallocHeap(size);
+
+    while ((SLAB_MIN_SIZE << sizeClass) < size) sizeClass++;
+
+    // The class's page with room, else a new page (the only svc call)
+    p = heap->partial[sizeClass];
+    if (p == SLAB_NO_PAGE) p = addSlabPage(heap, sizeClass);
+    if (p == SLAB_NO_PAGE) return NULL;
+    page = &heap->pages[p];
+
+    object = page->base + page->freeHead*objectSize(page);
+    page->freeHead = *object;
+    page->freeCount--;
+
+    if (page->freeCount == 0) heap->partial[sizeClass] = findPartialPage(heap, sizeClass, p);
+
+    return object;
+}
+
+// Returns an object from slabAlloc
+// An empty page goes back to the heap only while its class has room in
+// another page, so allocating and freeing one object never makes an svc call
+void slabFree(slabHeap *heap, void *ptr)
+{
+    uint8_t *object = ptr;
+    uint8_t *base = (uint8_t *)((uint32_t)ptr & ~(SLAB_PAGE_SIZE-1));
+    slabPage *page;
+    uint8_t p, other;
+
+    if (!ptr) return;
+
+    for (p = 0; p < SLAB_MAX_PAGES && heap->pages[p].base != base; p++);
+
+    // Not a slab object, so it came from mallocHeap
+    if (p == SLAB_MAX_PAGES)
+    {
+        freeHeap(ptr, 1);
+        return;
+    }
+
+    page = &heap->pages[p];
+
+    // Only the start of an object
+    if ((object - base) % objectSize(page)) return;
+
+    *object = page->freeHead;
+    page->freeHead = (object - base) / objectSize(page);
+    page->freeCount++;
+
+    if (heap->partial[page->sizeClass] == SLAB_NO_PAGE) heap->partial[page->sizeClass] = p;
+
+    if (page->freeCount == objectCount(page))
+    {
+        other = findPartialPage(heap, page->sizeClass, p);
+        if (other != SLAB_NO_PAGE)
+        {
+            heap->partial[page->sizeClass] = other;
+            freeHeap(page->base, SLAB_PAGE_SIZE);
+            page->base = NULL;
+        }
+    }
+}
+
+// Gives every empty page back to the heap
+void trimSlabHeap(slabHeap *heap)
+{
+    slabPage *page;
+    uint8_t p;
+
+    for (p = 0; p < SLAB_MAX_PAGES; p++)
+    {
+        page = &heap->pages[p];
+        if (!page->base || page->freeCount != objectCount(page)) continue;
+
+        freeHeap(page->base, SLAB_PAGE_SIZE);
+        page->base = NULL;
+        if (heap->partial[page->sizeClass] == p) heap->partial[page->sizeClass] = findPartialPage(heap, page->sizeClass, p);
+    }
+}
+
+// Fills stats with the pages each class holds and how full they are
+void getSlabStats(const slabHeap *heap, slabStats *stats)
+{
+    const slabPage *page;
+    uint8_t i;
+
+    for (i = 0; i < SLAB_NUM_CLASSES; i++)
+    {
+        stats->pages[i] = 0;
+        stats->used[i] = 0;
+        stats->capacity[i] = 0;
+    }
+    stats->bytesUsed = 0;
+    stats->bytesHeld = 0;
+
+    for (i = 0; i < SLAB_MAX_PAGES; i++)
+    {
+        page = &heap->pages[i];
+        if (!page->base) continue;
+
+        stats->pages[page->sizeClass]++;
+        stats->capacity[page->sizeClass] += objectCount(page);
+        stats->used[page->sizeClass] += objectCount(page) - page->freeCount;
+        stats->bytesUsed += (objectCount(page) - page->freeCount) * objectSize(page);
+        stats->bytesHeld += SLAB_PAGE_SIZE;
+    }
+}
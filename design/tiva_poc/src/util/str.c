@@ -77,7 +77,7 @@ uint32_t _pow(uint32_t base, uint32_t exp)
 {
     uint32_t out = 1;
 
-    int i;
+    uint32_t i;
     for (i = 0; i < exp; i++)
     {
         out *= base;